@@ -1,58 +1,63 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "kvstore.h"
 
-//列举kv存储协议中的所有指令
+//KV存储引擎
+kv_array_t kv_array;
+kv_rbtree_t kv_rbtree;
+kv_btree_t kv_btree;
+kv_skiplist_t kv_skiplist;
+kv_shash_t kv_shash;
+kv_dhash_t kv_dhash;
+
+#define KV_ENGINE_CMD_COUNT KV_CMD_OPS//每个存储引擎提供的指令数量
+#define KV_REPLY_RESERVE 64//除get外所有回复的最大长度，执行指令前预留
+#define KV_VALUE_REF_MIN 1024//get回复中不短于此长度的value以引用方式发送，更短的value直接拷贝比多一段iovec更快
+#define KV_RESP_LINE_MAX 32//RESP中数组长度和批量字符串长度所在行的最大长度
+#define KV_RESP_BULK_MAX (1024 * 1024 * 512)//RESP批量字符串的最大长度
+#define KV_CMD_HASH_BITS 9//指令名哈希表的位数，槽数是指令数量上限的5倍以上，容易找到没有冲突的乘数
+#define KV_CMD_HASH_SIZE (1 << KV_CMD_HASH_BITS)
+#define KV_CMD_HASH_TRIES 100000//构建哈希表时最多尝试的乘数个数
+#define KV_CMD_HASH_EMPTY 0xFF//哈希表中的空槽
+#define KV_CMD_MAX (KV_ENGINE_MAX * KV_ENGINE_CMD_COUNT)//所有引擎的指令数量上限
+#define KV_CMD_NAME_MIN 3//指令名的最小长度，哈希要读取倒数第三个字符
+#define KV_CMD_NAME_MAX 32//指令名的最大长度，更长的参数不可能是指令，不计算哈希
+#define KV_ARGC_KEYS (-1)//参数为一个或多个key
+#define KV_ARGC_PAIRS (-2)//参数为一对或多对key value
+#define KV_MC_ENGINE KV_BIN_SKIPLIST//memcached协议使用的存储引擎
+#define KV_MC_CMD(op) (KV_MC_ENGINE * KV_ENGINE_CMD_COUNT + (op))//memcached协议操作对应的指令编号，用于加锁
+#define KV_MC_TOKENS 8//memcached存储和删除指令行最多的参数数量，get的key数量不受此限制
+#define KV_MC_KEY_MAX 250//memcached key的最大长度
+#define KV_MC_VALUE_MAX (1024 * 1024)//memcached单个value的最大长度，与memcached默认的item上限相同
+#define KV_MC_REPLY_RESERVE (KV_MC_KEY_MAX + 64)//memcached回复中一行的最大长度，包括get回复的VALUE行
+
+//每个存储引擎提供的指令，指令编号为 引擎编号*KV_ENGINE_CMD_COUNT+操作
+//引擎编号为注册的顺序，内置引擎的编号与kv_bin_engine一致
 typedef enum kv_cmd_e {
-    KV_CMD_START = 0,//指令起始
+    KV_CMD_ERORR = -1,//指令格式错误
 
-    //ARRAY
-    KV_CMD_SET = KV_CMD_START,//插入
+    KV_CMD_SET = 0,//插入
     KV_CMD_GET,//查找
     KV_CMD_DELETE,//删除
     KV_CMD_COUNT,//计数
     KV_CMD_EXIST,//存在
+    KV_CMD_MGET,//批量查找
+    KV_CMD_MSET,//批量插入
+    KV_CMD_MDEL,//批量删除
+    KV_CMD_UPSERT,//插入或覆盖
+    KV_CMD_GETSET,//覆盖并返回旧value
+    KV_CMD_GETDEL,//删除并返回value
 
-    //RBTREE
-    KV_CMD_RBSET,//插入
-    KV_CMD_RBGET,//查找
-    KV_CMD_RBDELETE,//删除
-    KV_CMD_RBCOUNT,//计数
-    KV_CMD_RBEXIST,//存在
-
-    //BTREE
-    KV_CMD_BSET,//插入
-    KV_CMD_BGET,//查找
-    KV_CMD_BDELETE,//删除
-    KV_CMD_BCOUNT,//计数
-    KV_CMD_BEXIST,//存在
-
-    //SHASH
-    KV_CMD_SHSET,//插入
-    KV_CMD_SHGET,//查找
-    KV_CMD_SHDELETE,//删除
-    KV_CMD_SHCOUNT,//计数
-    KV_CMD_SHEXIST,//存在
-
-    //DHASH
-    KV_CMD_DHSET,//插入
-    KV_CMD_DHGET,//查找
-    KV_CMD_DHDELETE,//删除
-    KV_CMD_DHCOUNT,//计数
-    KV_CMD_DHEXIST,//存在
-
-    //SKIPLIST
-    KV_CMD_SKSET,//插入
-    KV_CMD_SKGET,//查找
-    KV_CMD_SKDELETE,//删除
-    KV_CMD_SKCOUNT,//计数
-    KV_CMD_SKEXIST,//存在
-
-    //CMD
-    KV_CMD_ERORR,//指令格式错误
-    KV_CMD_QUIT,//退出
-    KV_CMD_END,//指令结束
+    KV_CMD_OPS,//操作数量
 } kv_cmd;
 
 //用户指令结构体
@@ -61,7 +66,7 @@ typedef struct kv_user_argc_s {
     const int argc;//当前指令包含的参数数量
 } kv_user_argc;
 
-//列出用户可以使用的所有指令
+//每个存储引擎提供的操作，完整的指令名为引擎的前缀加上操作名，例如RB加GET为RBGET
 //此数组的存储顺序要和上面的枚举类型保持一致
 const kv_user_argc KV_COMMAND[] = {
     {"SET", 2},
@@ -69,37 +74,83 @@ const kv_user_argc KV_COMMAND[] = {
     {"DELETE", 1},
     {"COUNT", 0},
     {"EXIST", 1},
+    {"MGET", KV_ARGC_KEYS},
+    {"MSET", KV_ARGC_PAIRS},
+    {"MDEL", KV_ARGC_KEYS},
+    {"UPSERT", 2},
+    {"GETSET", 2},
+    {"GETDEL", 1},
+};
+
+/*------------存储引擎注册------------*/
+//把引擎自身类型的函数包装为操作表中统一的签名
+#define KV_ENGINE_WRAP(name, type) \
+static int kv_##name##_op_desy(void *store) { return kv_##name##_desy((type *)store); } \
+static int kv_##name##_op_set(void *store, kv_slice *tokens) { return kv_##name##_set((type *)store, tokens); } \
+static char *kv_##name##_op_get(void *store, kv_slice *tokens) { return kv_##name##_get((type *)store, tokens); } \
+static int kv_##name##_op_delete(void *store, kv_slice *tokens) { return kv_##name##_delete((type *)store, tokens); } \
+static int kv_##name##_op_count(void *store) { return kv_##name##_count((type *)store); } \
+static int kv_##name##_op_exist(void *store, kv_slice *tokens) { return kv_##name##_exist((type *)store, tokens); } \
+static int kv_##name##_op_upsert(void *store, kv_slice *tokens, char **old) { return kv_##name##_upsert((type *)store, tokens, old); }
+
+KV_ENGINE_WRAP(array, kv_array_t)
+KV_ENGINE_WRAP(rbtree, kv_rbtree_t)
+KV_ENGINE_WRAP(btree, kv_btree_t)
+KV_ENGINE_WRAP(shash, kv_shash_t)
+KV_ENGINE_WRAP(dhash, kv_dhash_t)
+KV_ENGINE_WRAP(skiplist, kv_skiplist_t)
+
+//只有B树和跳表的初始化需要参数，其余引擎没有可调的参数，忽略param
+static int kv_array_op_init(void *store, int param) { (void)param; return kv_array_init((kv_array_t *)store); }
+static int kv_rbtree_op_init(void *store, int param) { (void)param; return kv_rbtree_init((kv_rbtree_t *)store); }
+static int kv_btree_op_init(void *store, int param) { return kv_btree_init((kv_btree_t *)store, param); }
+static int kv_shash_op_init(void *store, int param) { (void)param; return kv_shash_init((kv_shash_t *)store); }
+static int kv_dhash_op_init(void *store, int param) { (void)param; return kv_dhash_init((kv_dhash_t *)store); }
+static int kv_skiplist_op_init(void *store, int param) { return kv_skiplist_init((kv_skiplist_t *)store, param); }
+
+#define KV_ENGINE_OPS(engine, pre, param) \
+    {#engine, pre, &kv_##engine, param, kv_##engine##_op_init, kv_##engine##_op_desy, kv_##engine##_op_set, \
+     kv_##engine##_op_get, kv_##engine##_op_delete, kv_##engine##_op_count, kv_##engine##_op_exist, kv_##engine##_op_upsert}
+
+//内置的六种存储引擎，顺序与kv_bin_engine一致
+static const kv_engine_ops KV_BUILTIN_ENGINES[] = {
+    KV_ENGINE_OPS(array, "", 0),
+    KV_ENGINE_OPS(rbtree, "RB", 0),
+    KV_ENGINE_OPS(btree, "B", 6),
+    KV_ENGINE_OPS(shash, "SH", 0),
+    KV_ENGINE_OPS(dhash, "DH", 0),
+    KV_ENGINE_OPS(skiplist, "SK", 6),
+};
 
-    {"RBSET", 2},
-    {"RBGET", 1},
-    {"RBDELETE", 1},
-    {"RBCOUNT", 0},
-    {"RBEXIST", 1},
-
-    {"BSET", 2},
-    {"BGET", 1},
-    {"BDELETE", 1},
-    {"BCOUNT", 0},
-    {"BEXIST", 1},
-
-    {"SHSET", 2},
-    {"SHGET", 1},
-    {"SHDELETE", 1},
-    {"SHCOUNT", 0},
-    {"SHEXIST", 1},
-
-    {"DHSET", 2},
-    {"DHGET", 1},
-    {"DHDELETE", 1},
-    {"DHCOUNT", 0},
-    {"DHEXIST", 1},
-
-    {"SKSET", 2},
-    {"SKGET", 1},
-    {"SKDELETE", 1},
-    {"SKCOUNT", 0},
-    {"SKEXIST", 1},
+//已注册的存储引擎，下标为引擎编号，kv_engine_init之后只读
+static const kv_engine_ops *kv_engines[KV_ENGINE_MAX] = {
+    &KV_BUILTIN_ENGINES[0],
+    &KV_BUILTIN_ENGINES[1],
+    &KV_BUILTIN_ENGINES[2],
+    &KV_BUILTIN_ENGINES[3],
+    &KV_BUILTIN_ENGINES[4],
+    &KV_BUILTIN_ENGINES[5],
 };
+static int kv_engine_count = sizeof(KV_BUILTIN_ENGINES) / sizeof(KV_BUILTIN_ENGINES[0]);
+
+//每个存储引擎一把读写锁，下标为 指令/KV_ENGINE_CMD_COUNT，即引擎编号
+static pthread_rwlock_t kv_engine_locks[KV_ENGINE_MAX];
+
+//注册存储引擎，前缀不能与已注册的引擎相同
+int kv_engine_register(const kv_engine_ops *ops) {
+    if(ops == NULL || ops->prefix == NULL || ops->store == NULL || kv_engine_count == KV_ENGINE_MAX) {
+        return -1;
+    }
+    for(int i = 0; i < kv_engine_count; i++) {
+        if(strcmp(kv_engines[i]->prefix, ops->prefix) == 0) {
+            fprintf(stderr, "engine %s : prefix \"%s\" already used by %s\n", ops->name, ops->prefix, kv_engines[i]->name);
+            return -1;
+        }
+    }
+    kv_engines[kv_engine_count] = ops;
+    return kv_engine_count++;
+}
+/*------------存储引擎注册------------*/
 
 //枚举给客户端返回信息
 typedef enum zv_res_t {
@@ -115,348 +166,992 @@ typedef enum zv_res_t {
     KV_RES_ERROR,
 } zv_res;
 
-//枚举具体返回信息
+//枚举具体返回信息，与zv_res一一对应
 const char *RES_MSG[] = {
     "OK\r\n",
     "ALREADY HAVE THIS KEY\r\n",
+    "FAIL\r\n",
+    "NO KEY\r\n",
     "TRUE\r\n",
     "FALSE\r\n",
     "ERROR COMMAND\r\n"
 };
 
-//初始化kv存储引擎
+//RESP协议的返回信息，与zv_res一一对应
+//get没有key时返回空批量字符串，删除成功与否和存在与否返回整数1/0
+const char *RESP_MSG[] = {
+    "+OK\r\n",
+    "-EXIST key already exists\r\n",
+    "-ERR operation failed\r\n",
+    "$-1\r\n",
+    ":1\r\n",
+    ":0\r\n",
+    "-ERR unknown command or wrong number of arguments\r\n"
+};
+
+/*------------指令名完美哈希------------*/
+//由已注册的引擎和KV_COMMAND在启动时构建，之后只读，reactor线程无需加锁
+//下标为指令名的哈希值，值为指令编号，空槽为KV_CMD_HASH_EMPTY；查找只需计算一次哈希并与唯一的候选比较一次
+static unsigned char kv_cmd_table[KV_CMD_HASH_SIZE];
+static char kv_cmd_names[KV_CMD_MAX][KV_CMD_NAME_MAX + 1];//各指令的完整指令名
+static size_t kv_cmd_lens[KV_CMD_MAX];//各指令名的长度
+static uint64_t kv_cmd_seed;//使所有指令落在不同槽中的乘数
+
+//取长度、前两个字符、倒数第三个和最后一个字符组成64位整数后做乘法哈希，字母按大写计算，RESP的小写指令名落在同一个槽
+//前两个字符区分引擎前缀，倒数第三个字符区分SET与GET，最后一个字符区分等长的UPSERT与DELETE，长度区分其余的操作
+static uint32_t kv_cmd_hash(const char *name, size_t len, uint64_t seed) {
+    uint64_t key = ((uint64_t)len << 32) | ((uint64_t)(name[0] & 0xDF) << 24) | ((uint64_t)(name[1] & 0xDF) << 16)
+        | ((uint64_t)(name[len - 3] & 0xDF) << 8) | (uint64_t)(name[len - 1] & 0xDF);
+    return (uint32_t)((key * seed) >> (64 - KV_CMD_HASH_BITS));
+}
+
+//拼出所有引擎的指令名，再依次尝试奇数乘数，直到所有指令都落在不同的槽中
+//新增引擎或操作不需要修改此处，只有与已有指令在长度和取样的四个字符上都相同时才需要修改kv_cmd_hash
+static int kv_cmd_table_init(void) {
+    int num_cmds = kv_engine_count * KV_ENGINE_CMD_COUNT;
+    for(int index = 0; index < num_cmds; index++) {
+        const char *prefix = kv_engines[index / KV_ENGINE_CMD_COUNT]->prefix;
+        const char *op = KV_COMMAND[index % KV_ENGINE_CMD_COUNT].cmd;
+        int len = snprintf(kv_cmd_names[index], KV_CMD_NAME_MAX + 1, "%s%s", prefix, op);
+        if(len < KV_CMD_NAME_MIN || len > KV_CMD_NAME_MAX) {
+            fprintf(stderr, "command name length out of range : %s%s\n", prefix, op);
+            return -1;
+        }
+        kv_cmd_lens[index] = len;
+    }
+    for(uint32_t i = 0; i < KV_CMD_HASH_TRIES; i++) {
+        uint64_t seed = 0x9E3779B97F4A7C15ull * (2 * i + 1);//相邻的奇数乘数高位几乎相同，乘以黄金分割常数打散
+        int index = 0;
+        memset(kv_cmd_table, KV_CMD_HASH_EMPTY, sizeof(kv_cmd_table));
+        for(index = 0; index < num_cmds; index++) {
+            uint32_t slot = kv_cmd_hash(kv_cmd_names[index], kv_cmd_lens[index], seed);
+            if(kv_cmd_table[slot] != KV_CMD_HASH_EMPTY) {
+                break;
+            }
+            kv_cmd_table[slot] = index;
+        }
+        if(index == num_cmds) {
+            kv_cmd_seed = seed;
+            return 0;
+        }
+    }
+    fprintf(stderr, "no perfect hash for command names, adjust kv_cmd_hash\n");
+    return -1;
+}
+
+//按引擎编号指定引擎的指令：编号.操作名，例如5.GET与SKGET相同，不需要知道引擎的前缀
+static int kv_cmd_find_id(const char *name, size_t len, int nocase) {
+    int engine = 0;
+    size_t i = 0;
+    for(; i < len && i < 3 && name[i] >= '0' && name[i] <= '9'; i++) {
+        engine = engine * 10 + (name[i] - '0');
+    }
+    if(i == 0 || i == len || name[i] != '.' || engine >= kv_engine_count) {
+        return KV_CMD_ERORR;
+    }
+    const char *op = name + i + 1;
+    size_t op_len = len - i - 1;
+    for(int index = 0; index < KV_ENGINE_CMD_COUNT; index++) {
+        const char *cmd = KV_COMMAND[index].cmd;
+        if(strlen(cmd) == op_len && (nocase ? strncasecmp(op, cmd, op_len) : memcmp(op, cmd, op_len)) == 0) {
+            return engine * KV_ENGINE_CMD_COUNT + index;
+        }
+    }
+    return KV_CMD_ERORR;
+}
+
+//查找长度为len的指令名，nocase不为0时不区分大小写，不是指令时返回KV_CMD_ERORR
+static int kv_cmd_find(const char *name, size_t len, int nocase) {
+    if(len > 0 && name[0] >= '0' && name[0] <= '9') {
+        return kv_cmd_find_id(name, len, nocase);
+    }
+    if(len < KV_CMD_NAME_MIN || len > KV_CMD_NAME_MAX) {
+        return KV_CMD_ERORR;
+    }
+    int index = kv_cmd_table[kv_cmd_hash(name, len, kv_cmd_seed)];
+    if(index == KV_CMD_HASH_EMPTY || kv_cmd_lens[index] != len) {
+        return KV_CMD_ERORR;
+    }
+    int diff = nocase ? strncasecmp(name, kv_cmd_names[index], len) : memcmp(name, kv_cmd_names[index], len);
+    return (diff == 0) ? index : KV_CMD_ERORR;
+}
+/*------------指令名完美哈希------------*/
+
+//初始化所有已注册的存储引擎
 int kv_engine_init(void) {
     int ret = 0;
-    ret += kv_array_init(&kv_array);
-    ret += kv_rbtree_init(&kv_rbtree);
-    ret += kv_btree_init(&kv_btree, 6);
-    ret += kv_shash_init(&kv_shash);
-    ret += kv_dhash_init(&kv_dhash);
-    ret += kv_skiplist_init(&kv_skiplist, 6);
+    for(int i = 0; i < kv_engine_count; i++) {
+        ret += pthread_rwlock_init(&kv_engine_locks[i], NULL);
+        ret += kv_engines[i]->init(kv_engines[i]->store, kv_engines[i]->param);
+    }
+    ret += kv_cmd_table_init();
     return ret;
 }
 
-//销毁kv存储引擎
+//销毁所有已注册的存储引擎
 int kv_engine_desy(void) {
     int ret = 0;
-    ret += kv_array_desy(&kv_array);
-    ret += kv_rbtree_desy(&kv_rbtree);
-    ret += kv_btree_desy(&kv_btree);
-    ret += kv_shash_desy(&kv_shash);
-    ret += kv_dhash_desy(&kv_dhash);
-    ret += kv_skiplist_desy(&kv_skiplist);
+    for(int i = 0; i < kv_engine_count; i++) {
+        ret += kv_engines[i]->desy(kv_engines[i]->store);
+    }
+    for(int i = 0; i < kv_engine_count; i++) {
+        ret += pthread_rwlock_destroy(&kv_engine_locks[i]);
+    }
     return ret;
 }
 
-//按照空格拆分用户指令，返回拆分后的指令数量
-int kv_split_tokens(char **tokens, char *msg) {
-    int count = 0;//解析的指令数量
-    char *ptr;
-    tokens[count] = strtok_r(msg, " ", &ptr);
-    while(tokens[count] != NULL) {
-        count++;
-        tokens[count] = strtok_r(NULL, " ", &ptr);
+//保证buf在有效数据之后至少还有need字节的空间
+int kv_buf_reserve(kv_buf *buf, size_t need) {
+    if(buf->size - buf->len >= need) {
+        return 0;
+    }
+    size_t size = buf->size ? buf->size * 2 : need;
+    while(size - buf->len < need) {
+        size *= 2;
     }
-    return count--;
+    char *data = (char *)realloc(buf->data, size);
+    if(data == NULL) {
+        return -1;
+    }
+    buf->data = data;
+    buf->size = size;
+    return 0;
 }
 
-//解析用户指令，判断用户输入的是哪一个kv_cmd
-int kv_parser_cmd(char **tokens, int num_tokens) {
-    if(tokens == NULL || tokens[0] == NULL || num_tokens == 0) {
-        return KV_CMD_ERORR;
+//在out当前位置插入value的引用
+int kv_out_ref(kv_out *out, char *value) {
+    if(out->nref == out->ref_size) {
+        int ref_size = out->ref_size ? out->ref_size * 2 : 8;
+        kv_ref *refs = (kv_ref *)realloc(out->refs, ref_size * sizeof(kv_ref));
+        if(refs == NULL) {
+            return -1;
+        }
+        out->refs = refs;
+        out->ref_size = ref_size;
     }
-    int index = 0;
-    for(index = 0; index < KV_CMD_ERORR; index++) {
-        if(strcmp(tokens[0], KV_COMMAND[index].cmd) == 0) {
-            if(KV_COMMAND[index].argc == num_tokens - 1) {
+    out->refs[out->nref].pos = out->buf.len;
+    out->refs[out->nref].value = kv_value_ref(value);
+    out->nref++;
+    out->ref_bytes += kv_value_len(value);
+    return 0;
+}
+
+//out中尚未发送的字节数
+size_t kv_out_len(const kv_out *out) {
+    return out->buf.len + out->ref_bytes - out->ref_sent;
+}
+
+//按顺序交替填入buf中两个引用之间的字节和引用的value
+int kv_out_iov(const kv_out *out, struct iovec *iov, int iovcnt, size_t split) {
+    int count = 0;
+    size_t off = 0;//buf中已填入的位置
+    for(int i = 0; i <= out->nref && count < iovcnt; i++) {
+        size_t end = (i < out->nref) ? out->refs[i].pos : out->buf.len;
+        if(end > off) {
+            iov[count].iov_base = out->buf.data + off;
+            iov[count].iov_len = end - off;
+            count++;
+            off = end;
+        }
+        if(i < out->nref && count < iovcnt) {
+            size_t len = kv_value_len(out->refs[i].value);
+            if(split > 0 && len >= split && count > 0) {
                 break;
             }
-            else {
-                return KV_CMD_ERORR;
+            size_t sent = (i == 0) ? out->ref_sent : 0;
+            iov[count].iov_base = out->refs[i].value + sent;
+            iov[count].iov_len = len - sent;
+            count++;
+            if(split > 0 && len >= split) {
+                break;
             }
         }
     }
-    return index;//若都不匹配，返回KV_CMD_ERROR
+    return count;
+}
+
+//out开头尚未发送的数据是引用的value时返回该value
+char *kv_out_head_ref(const kv_out *out) {
+    if(out->nref > 0 && out->refs[0].pos == 0) {
+        return out->refs[0].value;
+    }
+    return NULL;
+}
+
+//去掉已发送的len字节：依次消耗buf中的字节和引用的value，最后把剩余数据前移
+void kv_out_consume(kv_out *out, size_t len) {
+    size_t off = 0;//buf中已发送的字节数
+    int done = 0;//已发送完的引用数
+    while(len > 0) {
+        size_t end = (done < out->nref) ? out->refs[done].pos : out->buf.len;
+        size_t n = (end - off < len) ? end - off : len;
+        off += n;
+        len -= n;
+        if(len == 0 || done == out->nref) {
+            break;
+        }
+        char *value = out->refs[done].value;
+        size_t rest = kv_value_len(value) - out->ref_sent;
+        if(len < rest) {
+            out->ref_sent += len;
+            break;
+        }
+        len -= rest;
+        out->ref_sent = 0;
+        out->ref_bytes -= kv_value_len(value);
+        kv_value_unref(value);
+        done++;
+    }
+    out->buf.len -= off;
+    memmove(out->buf.data, out->buf.data + off, out->buf.len);
+    out->nref -= done;
+    for(int i = 0; i < out->nref; i++) {
+        out->refs[i] = out->refs[i + done];
+        out->refs[i].pos -= off;
+    }
+}
+
+//释放所有value引用
+void kv_out_reset(kv_out *out) {
+    for(int i = 0; i < out->nref; i++) {
+        kv_value_unref(out->refs[i].value);
+    }
+    free(out->refs);
+    out->refs = NULL;
+    out->nref = 0;
+    out->ref_size = 0;
+    out->ref_bytes = 0;
+    out->ref_sent = 0;
+}
+
+/*------------指令拆分------------*/
+//从p开始查找第一个空格（space不为0）或第一个非空格（space为0）的位置，没有时返回end
+//每次比较一个向量宽度的字节，得到的掩码中最低的置位即为结果，不足一个向量的尾部逐字节比较
+static const char *kv_scan_space(const char *p, const char *end, int space) {
+#if defined(__AVX2__)
+    const __m256i spaces32 = _mm256_set1_epi8(' ');
+    while(end - p >= 32) {
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), spaces32));
+        mask = space ? mask : ~mask;
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i spaces16 = _mm_set1_epi8(' ');
+    while(end - p >= 16) {
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), spaces16));
+        mask = space ? mask : (~mask & 0xFFFF);
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while(p < end && (*p == ' ') != (space != 0)) {
+        p++;
+    }
+    return p;
+}
+
+//按空格拆分[data, data + len)，最多把max个参数的起始位置和长度存入tokens，不修改数据
+//返回参数总数，可能大于max
+int kv_split_tokens(const char *data, size_t len, kv_slice *tokens, int max) {
+    const char *end = data + len;
+    const char *p = data;
+    int count = 0;
+    while((p = kv_scan_space(p, end, 0)) < end) {
+        const char *start = p;
+        p = kv_scan_space(p, end, 1);
+        if(count < max) {
+            tokens[count].data = start;
+            tokens[count].len = p - start;
+        }
+        count++;
+    }
+    return count;
+}
+
+//判断参数是否为指定的字符串，nocase不为0时不区分大小写
+static int kv_token_is(kv_slice token, const char *str, int nocase) {
+    if(strlen(str) != token.len) {
+        return 0;
+    }
+    return (nocase ? strncasecmp(token.data, str, token.len) : memcmp(token.data, str, token.len)) == 0;
+}
+/*------------指令拆分------------*/
+
+//判断参数数量是否符合指令的要求
+static int kv_cmd_argc_ok(int argc, int num_args) {
+    if(argc == KV_ARGC_KEYS) {
+        return num_args >= 1;
+    }
+    if(argc == KV_ARGC_PAIRS) {
+        return num_args >= 2 && num_args % 2 == 0;
+    }
+    return argc == num_args;
+}
+
+//解析用户指令，判断用户输入的是哪一个kv_cmd，RESP与Redis一样指令名不区分大小写
+//指令名通过完美哈希定位，参数数量不符或超过MAX_TOKENS（多余的参数没有保存）时同样返回KV_CMD_ERORR
+int kv_parser_cmd(kv_slice *tokens, int num_tokens, int proto) {
+    if(tokens == NULL || num_tokens == 0 || num_tokens > MAX_TOKENS || tokens[0].data == NULL) {
+        return KV_CMD_ERORR;
+    }
+    int index = kv_cmd_find(tokens[0].data, tokens[0].len, proto == KV_PROTO_RESP);
+    if(index == KV_CMD_ERORR || !kv_cmd_argc_ok(KV_COMMAND[index % KV_ENGINE_CMD_COUNT].argc, num_tokens - 1)) {
+        return KV_CMD_ERORR;
+    }
+    return index;
+}
+
+//只取第一个空格之前的指令名，不修改msg
+int kv_lookup_command(const char *msg, size_t len) {
+    int index = kv_cmd_find(msg, kv_scan_space(msg, msg + len, 1) - msg, 0);
+    if(index == KV_CMD_ERORR) {
+        return 0;
+    }
+    int op = index % KV_ENGINE_CMD_COUNT;
+    return (op == KV_CMD_GET || op == KV_CMD_EXIST || op == KV_CMD_MGET);
+}
+
+//二进制协议的回复状态，与zv_res一一对应
+const uint8_t BIN_STATUS[] = {
+    KV_BIN_OK,
+    KV_BIN_EXISTS,
+    KV_BIN_FAIL,
+    KV_BIN_NOT_FOUND,
+    KV_BIN_OK,
+    KV_BIN_NOT_FOUND,
+    KV_BIN_BAD_REQUEST,
+};
+
+//设置缓冲区开头二进制回复头部中的value长度，缓冲区不一定按4字节对齐
+static void kv_bin_set_value_len(char *buffer, uint32_t value_len) {
+    value_len = htonl(value_len);
+    memcpy(buffer + offsetof(kv_bin_header, value_len), &value_len, sizeof(value_len));
+}
+
+//按协议把返回信息拷贝到缓冲区
+//二进制协议的回复头部已由kv_bin_protocol写在缓冲区开头，只需填入状态
+size_t kv_setbuffer_msg(char *buffer, int proto, int res) {
+    if(proto == KV_PROTO_BIN) {
+        ((kv_bin_header *)buffer)->status = BIN_STATUS[res];
+        return sizeof(kv_bin_header);
+    }
+    const char *msg = (proto == KV_PROTO_RESP) ? RESP_MSG[res] : RES_MSG[res];
+    size_t msg_len = strlen(msg);
+    memcpy(buffer, msg, msg_len);
+    return msg_len;
 }
 
 //set指令返回的信息拷贝到缓冲区
-size_t kv_setbuffer_set(char *buffer, int ret) {
-    size_t msg_len = 0;
+size_t kv_setbuffer_set(char *buffer, int ret, int proto) {
     //成功
     if(ret == 0) {
-        msg_len = strlen(RES_MSG[KV_RES_OK]);
-        strncpy(buffer, RES_MSG[KV_RES_OK], msg_len);
+        return kv_setbuffer_msg(buffer, proto, KV_RES_OK);
     }
     //已经存在
     else if(ret == -2) {
-        msg_len = strlen(RES_MSG[KV_RES_AL_HAVE]);
-        strncpy(buffer, RES_MSG[KV_RES_AL_HAVE], msg_len);
+        return kv_setbuffer_msg(buffer, proto, KV_RES_AL_HAVE);
     }
     //失败
     else {
-        msg_len = strlen(RES_MSG[KV_RES_FAIL]);
-        strncpy(buffer, RES_MSG[KV_RES_FAIL], msg_len);
+        return kv_setbuffer_msg(buffer, proto, KV_RES_FAIL);
     }
-    return msg_len;
 }
 
-//get指令返回的信息拷贝到缓冲区
-size_t kv_setbuffer_get(char *buffer, size_t max_buffer_len, char *value) {
-    size_t msg_len = 0;
+//在out缓冲区末尾已写入的head字节之后追加value，crlf不为0时再追加\r\n，不修改buf.len，返回head加上追加的字节数，内存不足返回0
+//较长的value以引用方式插入，发送时直接使用引擎中value的内存；较短的value拷贝到缓冲区，空间不足时扩容
+//调用前缓冲区末尾至少预留了head + 2字节
+static size_t kv_setbuffer_value(kv_out *out, size_t head, char *value, int crlf) {
+    size_t base = out->buf.len;
+    size_t value_len = kv_value_len(value);
+    size_t tail = crlf ? 2 : 0;
+    if(value_len >= KV_VALUE_REF_MIN) {
+        out->buf.len = base + head;
+        int ret = kv_out_ref(out, value);
+        out->buf.len = base;
+        if(ret != 0) {
+            return 0;
+        }
+        memcpy(out->buf.data + base + head, "\r\n", tail);
+        return head + tail;
+    }
+    if(kv_buf_reserve(&out->buf, head + value_len + tail) != 0) {
+        return 0;
+    }
+    char *buffer = out->buf.data + base;
+    memcpy(buffer + head, value, value_len);
+    memcpy(buffer + head + value_len, "\r\n", tail);
+    return head + value_len + tail;
+}
+
+//get指令返回的信息写入out，RESP的value前加上长度前缀，引用插入在前缀之后
+size_t kv_setbuffer_get(kv_out *out, char *value, int proto) {
+    size_t base = out->buf.len;//本条回复的起始位置，返回后由kv_execute统一加上回复长度
     if(value == NULL) {
-        msg_len = strlen(RES_MSG[KV_RES_NO_KEY]);
-        strncpy(buffer, RES_MSG[KV_RES_NO_KEY], msg_len);
+        return kv_setbuffer_msg(out->buf.data + base, proto, KV_RES_NO_KEY);
     }
-    else {
-        msg_len = snprintf(buffer, max_buffer_len, "%s\r\n", value);
+    size_t head = 0;//RESP批量字符串的长度前缀，或二进制协议的回复头部
+    if(proto == KV_PROTO_RESP) {
+        head = snprintf(out->buf.data + base, KV_REPLY_RESERVE, "$%zu\r\n", kv_value_len(value));
     }
-    return msg_len;
+    else if(proto == KV_PROTO_BIN) {
+        kv_bin_set_value_len(out->buf.data + base, (uint32_t)kv_value_len(value));
+        head = sizeof(kv_bin_header);
+    }
+    return kv_setbuffer_value(out, head, value, proto != KV_PROTO_BIN);
 }
 
-//delete指令返回的信息拷贝到缓冲区
-size_t kv_setbuffer_delete(char *buffer, int ret) {
-    size_t msg_len = 0;
+//delete指令返回的信息拷贝到缓冲区，RESP与Redis的DEL一样返回删除的数量
+size_t kv_setbuffer_delete(char *buffer, int ret, int proto) {
     if(ret == -2) {
-        msg_len = strlen(RES_MSG[KV_RES_NO_KEY]);
-        strncpy(buffer, RES_MSG[KV_RES_NO_KEY], msg_len);
+        return kv_setbuffer_msg(buffer, proto, (proto == KV_PROTO_RESP) ? KV_RES_FALSE : KV_RES_NO_KEY);
     }
     else if(ret == 0) {
-        msg_len = strlen(RES_MSG[KV_RES_OK]);
-        strncpy(buffer, RES_MSG[KV_RES_OK], msg_len);
+        return kv_setbuffer_msg(buffer, proto, (proto == KV_PROTO_RESP) ? KV_RES_TRUE : KV_RES_OK);
     }
     else {
-        msg_len = strlen(RES_MSG[KV_RES_FAIL]);
-        strncpy(buffer, RES_MSG[KV_RES_FAIL], msg_len);
+        return kv_setbuffer_msg(buffer, proto, KV_RES_FAIL);
     }
-    return msg_len;
+}
+
+//mget指令的回复：文本协议每个key一行，与依次执行get的回复相同；RESP为数组，不存在的key为空批量字符串
+//每个value的回复直接追加到out，返回值与kv_setbuffer_get相同，内存不足返回0
+//tokens[i - 1]开始的两项在引擎看来就是只有一个key的指令，不需要拷贝参数
+static size_t kv_setbuffer_mget(kv_out *out, const kv_engine_ops *engine, kv_slice *tokens, int num_tokens, int proto) {
+    size_t base = out->buf.len;
+    if(proto == KV_PROTO_RESP) {
+        out->buf.len += snprintf(out->buf.data + base, KV_REPLY_RESERVE, "*%d\r\n", num_tokens - 1);
+    }
+    for(int i = 1; i < num_tokens; i++) {
+        if(kv_buf_reserve(&out->buf, KV_REPLY_RESERVE) != 0) {
+            out->buf.len = base;
+            return 0;
+        }
+        char *value = engine->get(engine->store, &tokens[i - 1]);
+        size_t msg_len = kv_setbuffer_get(out, value, proto);
+        if(msg_len == 0) {
+            out->buf.len = base;
+            return 0;
+        }
+        out->buf.len += msg_len;
+    }
+    size_t total = out->buf.len - base;
+    out->buf.len = base;
+    return total;
 }
 
 //count指令返回的信息拷贝到缓冲区
-size_t kv_setbuffer_count(char *buffer, int count) {
-    size_t msg_len = 0;//返回信息的长度
-    char s_cnt[10];
-    msg_len = snprintf(s_cnt, sizeof(s_cnt), "%d\r\n", count);
-    strncpy(buffer, s_cnt, msg_len);
-    return msg_len;
+size_t kv_setbuffer_count(char *buffer, int count, int proto) {
+    if(proto == KV_PROTO_BIN) {
+        uint32_t num = htonl((uint32_t)count);
+        kv_bin_set_value_len(buffer, sizeof(num));
+        memcpy(buffer + sizeof(kv_bin_header), &num, sizeof(num));
+        return sizeof(kv_bin_header) + sizeof(num);
+    }
+    return snprintf(buffer, KV_REPLY_RESERVE, (proto == KV_PROTO_RESP) ? ":%d\r\n" : "%d\r\n", count);
 }
 
 //exist指令返回的信息拷贝到缓冲区
-size_t kv_setbuffer_exist(char *buffer, int ret) {
-    size_t msg_len = 0;
+size_t kv_setbuffer_exist(char *buffer, int ret, int proto) {
     if(ret == 1) {
-        msg_len = strlen(RES_MSG[KV_RES_TRUE]);
-        strncpy(buffer, RES_MSG[KV_RES_TRUE], msg_len);
+        return kv_setbuffer_msg(buffer, proto, KV_RES_TRUE);
     }
     else if(ret == 0) {
-        msg_len = strlen(RES_MSG[KV_RES_FALSE]);
-        strncpy(buffer, RES_MSG[KV_RES_FALSE], msg_len);
+        return kv_setbuffer_msg(buffer, proto, KV_RES_FALSE);
     }
     else {
-        msg_len = strlen(RES_MSG[KV_RES_ERROR]);
-        strncpy(buffer, RES_MSG[KV_RES_ERROR], msg_len);
+        return kv_setbuffer_msg(buffer, proto, KV_RES_ERROR);
     }
-    return msg_len;
 }
 
-//实现完整的kv存储引擎
-size_t kv_protocol(char *buffer, size_t max_buffer_len) {
-    char *tokens[MAX_TOKENS] = {NULL};//用户指令拆分后的指令数组
-    int num_tokens = kv_split_tokens(tokens, buffer);//拆分用户指令
+//不属于任何存储引擎的指令：RESP下回应PING，并对redis-benchmark等客户端启动时发送的COMMAND/CONFIG返回空数组
+size_t kv_setbuffer_other(char *buffer, kv_slice *tokens, int num_tokens, int proto) {
+    if(proto == KV_PROTO_RESP && num_tokens > 0 && tokens[0].data != NULL) {
+        const char *msg = NULL;
+        if(kv_token_is(tokens[0], "PING", 1)) {
+            msg = "+PONG\r\n";
+        }
+        else if(kv_token_is(tokens[0], "COMMAND", 1) || kv_token_is(tokens[0], "CONFIG", 1)) {
+            msg = "*0\r\n";
+        }
+        if(msg) {
+            size_t msg_len = strlen(msg);
+            memcpy(buffer, msg, msg_len);
+            return msg_len;
+        }
+    }
+    return kv_setbuffer_msg(buffer, proto, KV_RES_ERROR);
+}
+
+//解析RESP中以\r\n结尾的整数行，p指向类型字符之后，返回1成功，0数据不完整，-1格式错误
+static int kv_resp_number(const char *p, const char *end, long *num, const char **next) {
+    size_t avail = end - p;
+    const char *cr = (const char *)memchr(p, '\r', avail < KV_RESP_LINE_MAX ? avail : KV_RESP_LINE_MAX);
+    if(cr == NULL) {
+        return avail < KV_RESP_LINE_MAX ? 0 : -1;
+    }
+    if(cr + 1 >= end) {
+        return 0;
+    }
+    if(cr[1] != '\n' || cr == p) {
+        return -1;
+    }
+    int negative = (*p == '-');
+    long n = 0;
+    for(const char *q = p + negative; q < cr; q++) {
+        if(*q < '0' || *q > '9' || n > KV_RESP_BULK_MAX) {
+            return -1;
+        }
+        n = n * 10 + (*q - '0');
+    }
+    *num = negative ? -n : n;
+    *next = cr + 2;
+    return 1;
+}
+
+//参数直接指向缓冲区中批量字符串的内容，长度取自长度前缀，不修改缓冲区
+//数据不完整时下次到达更多数据后重新解析；批量字符串按长度前缀跳过，不扫描其内容
+int kv_resp_parse(const char *data, size_t len, kv_slice *tokens, int max_tokens, int *num_tokens) {
+    const char *end = data + len;
+    const char *p = data;
+    long count = 0;
+    if(len == 0) {
+        return 0;
+    }
+    if(*p != '*') {
+        return -1;
+    }
+    int ret = kv_resp_number(p + 1, end, &count, &p);
+    if(ret <= 0) {
+        return ret;
+    }
+    if(count < 0 || count > KV_RESP_BULK_MAX) {
+        return -1;
+    }
+    for(long i = 0; i < count; i++) {
+        long bulk_len = 0;
+        if(p >= end) {
+            return 0;
+        }
+        if(*p != '$') {
+            return -1;
+        }
+        ret = kv_resp_number(p + 1, end, &bulk_len, &p);
+        if(ret <= 0) {
+            return ret;
+        }
+        if(bulk_len < 0) {
+            return -1;
+        }
+        if((size_t)(end - p) < (size_t)bulk_len + 2) {
+            return 0;
+        }
+        if(p[bulk_len] != '\r' || p[bulk_len + 1] != '\n') {
+            return -1;
+        }
+        if(i < max_tokens) {
+            tokens[i].data = p;
+            tokens[i].len = bulk_len;
+        }
+        p += bulk_len + 2;
+    }
+    *num_tokens = (int)count;
+    return (int)(p - data);
+}
+
+//指令执行前对其所属的存储引擎加锁，只有修改数据的指令需要写锁
+static void kv_engine_lock(int user_cmd) {
+    if(user_cmd < 0 || user_cmd >= kv_engine_count * KV_ENGINE_CMD_COUNT) {
+        return;
+    }
+    int op = user_cmd % KV_ENGINE_CMD_COUNT;
+    pthread_rwlock_t *lock = &kv_engine_locks[user_cmd / KV_ENGINE_CMD_COUNT];
+    if(op == KV_CMD_SET || op == KV_CMD_DELETE || op == KV_CMD_MSET || op == KV_CMD_MDEL
+        || op == KV_CMD_UPSERT || op == KV_CMD_GETSET || op == KV_CMD_GETDEL) {
+        pthread_rwlock_wrlock(lock);
+    }
+    else {
+        pthread_rwlock_rdlock(lock);
+    }
+}
+
+//指令执行完毕后释放其所属存储引擎的锁
+static void kv_engine_unlock(int user_cmd) {
+    if(user_cmd < 0 || user_cmd >= kv_engine_count * KV_ENGINE_CMD_COUNT) {
+        return;
+    }
+    pthread_rwlock_unlock(&kv_engine_locks[user_cmd / KV_ENGINE_CMD_COUNT]);
+}
+
+static int kv_execute_cmd(int user_cmd, kv_slice *tokens, int num_tokens, kv_out *out, int proto);
+
+//文本协议：msg为一条长度为len的完整指令，不含换行，按空格拆分后执行
+int kv_protocol(const char *msg, size_t len, kv_out *out) {
+    kv_slice tokens[MAX_TOKENS];//用户指令拆分后的指令数组
+    int num_tokens = kv_split_tokens(msg, len, tokens, MAX_TOKENS);//拆分用户指令，参数过多时指令名之后的参数数量不符，按错误指令回复
+    return kv_execute(tokens, num_tokens, out, KV_PROTO_TEXT);
+}
+
+//按指令名解析已拆分的指令后执行
+int kv_execute(kv_slice *tokens, int num_tokens, kv_out *out, int proto) {
+    int user_cmd = kv_parser_cmd(tokens, num_tokens, proto);//解析用户指令
+    return kv_execute_cmd(user_cmd, tokens, num_tokens, out, proto);
+}
+
+//实现完整的kv存储引擎，user_cmd为已确定的指令编号，由编号找到引擎的操作表后执行，tokens[1]为key，tokens[2]为value
+//回复追加到out中，返回信息在锁内写入out，get返回的value在锁内拷贝或增加引用计数，因此不会被其他线程提前释放
+static int kv_execute_cmd(int user_cmd, kv_slice *tokens, int num_tokens, kv_out *out, int proto) {
+    if(kv_buf_reserve(&out->buf, KV_REPLY_RESERVE) != 0) {
+        return -1;
+    }
+    char *buffer = out->buf.data + out->buf.len;
 
-    int user_cmd = kv_parser_cmd(tokens, num_tokens);//解析用户指令
     size_t msg_len = 0;//返回缓冲区的有效字符串长度
-    switch (user_cmd)
+    if(user_cmd == KV_CMD_ERORR) {
+        msg_len = kv_setbuffer_other(buffer, tokens, num_tokens, proto);
+        out->buf.len += msg_len;
+        return 0;
+    }
+    const kv_engine_ops *engine = kv_engines[user_cmd / KV_ENGINE_CMD_COUNT];
+    kv_engine_lock(user_cmd);
+    switch (user_cmd % KV_ENGINE_CMD_COUNT)
     {
         case KV_CMD_SET:{
-            int ret = kv_array_set(&kv_array, tokens);
-            msg_len = kv_setbuffer_set(buffer, ret);
+            int ret = engine->set(engine->store, tokens);
+            msg_len = kv_setbuffer_set(buffer, ret, proto);
             break;
         }
-        
+
         case KV_CMD_GET:{
-            char *value = kv_array_get(&kv_array, tokens);
-            msg_len = kv_setbuffer_get(buffer, max_buffer_len, value);
+            char *value = engine->get(engine->store, tokens);
+            msg_len = kv_setbuffer_get(out, value, proto);
             break;
         }
 
         case KV_CMD_DELETE:{
-            int ret = kv_array_delete(&kv_array, tokens);
-            msg_len = kv_setbuffer_delete(buffer, ret);
+            int ret = engine->del(engine->store, tokens);
+            msg_len = kv_setbuffer_delete(buffer, ret, proto);
             break;
         }
 
         case KV_CMD_COUNT:{
-            int count = kv_array_count(&kv_array);
-            msg_len = kv_setbuffer_count(buffer, count);
+            int count = engine->count(engine->store);
+            msg_len = kv_setbuffer_count(buffer, count, proto);
             break;
         }
 
         case KV_CMD_EXIST:{
-            int ret = kv_array_exist(&kv_array, tokens);
-            msg_len = kv_setbuffer_exist(buffer, ret);
+            int ret = engine->exist(engine->store, tokens);
+            msg_len = kv_setbuffer_exist(buffer, ret, proto);
             break;
         }
 
-        case KV_CMD_RBSET:{
-            int ret = kv_rbtree_set(&kv_rbtree, tokens);
-            msg_len = kv_setbuffer_set(buffer, ret);
+        case KV_CMD_MGET:{
+            msg_len = kv_setbuffer_mget(out, engine, tokens, num_tokens, proto);
             break;
         }
 
-        case KV_CMD_RBGET:{
-            char *value = kv_rbtree_get(&kv_rbtree, tokens);
-            msg_len = kv_setbuffer_get(buffer, max_buffer_len, value);
+        //批量插入和删除返回成功的数量，已经存在的key不会被覆盖
+        case KV_CMD_MSET:{
+            int count = 0;
+            for(int i = 1; i + 1 < num_tokens; i += 2) {
+                count += (engine->set(engine->store, &tokens[i - 1]) == 0);
+            }
+            msg_len = kv_setbuffer_count(buffer, count, proto);
             break;
         }
 
-        case KV_CMD_RBDELETE:{
-            int ret = kv_rbtree_delete(&kv_rbtree, tokens);
-            msg_len = kv_setbuffer_delete(buffer, ret);
+        case KV_CMD_MDEL:{
+            int count = 0;
+            for(int i = 1; i < num_tokens; i++) {
+                count += (engine->del(engine->store, &tokens[i - 1]) == 0);
+            }
+            msg_len = kv_setbuffer_count(buffer, count, proto);
             break;
         }
 
-        case KV_CMD_RBCOUNT:{
-            int count = kv_rbtree_count(&kv_rbtree);
-            msg_len = kv_setbuffer_count(buffer, count);
+        //key已存在时引擎只替换value指针，不需要先删除再插入
+        case KV_CMD_UPSERT:{
+            int ret = engine->upsert(engine->store, tokens, NULL);
+            msg_len = kv_setbuffer_set(buffer, (ret < 0) ? -1 : 0, proto);
             break;
         }
 
-        case KV_CMD_RBEXIST:{
-            int ret = kv_rbtree_exist(&kv_rbtree, tokens);
-            msg_len = kv_setbuffer_exist(buffer, ret);
+        //返回被替换的旧value，key原来不存在时与get没有找到key的回复相同
+        case KV_CMD_GETSET:{
+            char *old = NULL;
+            int ret = engine->upsert(engine->store, tokens, &old);
+            if(ret < 0) {
+                msg_len = kv_setbuffer_msg(buffer, proto, KV_RES_FAIL);
+                break;
+            }
+            msg_len = kv_setbuffer_get(out, old, proto);
+            kv_value_unref(old);
             break;
         }
 
-        case KV_CMD_BSET:{
-            int ret = kv_btree_set(&kv_btree, tokens);
-            msg_len = kv_setbuffer_set(buffer, ret);
+        //删除前先持有value的一个引用，删除后再写入回复
+        case KV_CMD_GETDEL:{
+            char *value = kv_value_ref(engine->get(engine->store, tokens));
+            if(value != NULL && engine->del(engine->store, tokens) != 0) {
+                kv_value_unref(value);
+                msg_len = kv_setbuffer_msg(buffer, proto, KV_RES_FAIL);
+                break;
+            }
+            msg_len = kv_setbuffer_get(out, value, proto);
+            kv_value_unref(value);
             break;
         }
 
-        case KV_CMD_BGET:{
-            char *value = kv_btree_get(&kv_btree, tokens);
-            msg_len = kv_setbuffer_get(buffer, max_buffer_len, value);
-            break;
+        default:{
+            msg_len = kv_setbuffer_msg(buffer, proto, KV_RES_ERROR);
         }
+    }
+    kv_engine_unlock(user_cmd);
+    if(msg_len == 0) {//get的回复扩容失败
+        return -1;
+    }
+    out->buf.len += msg_len;
+    return 0;
+}
 
-        case KV_CMD_BDELETE:{
-            int ret = kv_btree_delete(&kv_btree, tokens);
-            msg_len = kv_setbuffer_delete(buffer, ret);
-            break;
-        }
 
-        case KV_CMD_BCOUNT:{
-            int count = kv_btree_count(&kv_btree);
-            msg_len = kv_setbuffer_count(buffer, count);
-            break;
-        }
+/*------------二进制协议------------*/
+//指令直接由engine和opcode计算得到；key和value以长度直接交给引擎，不拷贝也不修改接收缓冲区
+//回复与请求的顺序相同，回复头部带回opaque，客户端可以按opaque匹配，不依赖顺序
+int kv_bin_protocol(const char *data, size_t len, kv_out *out) {
+    kv_bin_header req;
+    if(len < sizeof(kv_bin_header)) {
+        return 0;
+    }
+    memcpy(&req, data, sizeof(req));
+    uint32_t key_len = ntohl(req.key_len);
+    uint32_t value_len = ntohl(req.value_len);
+    if(req.magic != KV_BIN_REQ || key_len > KV_BIN_KEY_MAX || value_len > KV_BIN_VALUE_MAX) {
+        return -1;
+    }
+    size_t used = sizeof(kv_bin_header) + key_len + value_len;
+    if(len < used) {
+        return 0;
+    }
+    //回复头部先写入缓冲区，kv_execute_cmd再填入状态和value
+    if(kv_buf_reserve(&out->buf, KV_REPLY_RESERVE) != 0) {
+        return -1;
+    }
+    kv_bin_header res;
+    memset(&res, 0, sizeof(res));
+    res.magic = KV_BIN_RES;
+    res.opcode = req.opcode;
+    res.engine = req.engine;
+    res.opaque = req.opaque;
+    memcpy(out->buf.data + out->buf.len, &res, sizeof(res));
 
-        case KV_CMD_BEXIST:{
-            int ret = kv_btree_exist(&kv_btree, tokens);
-            msg_len = kv_setbuffer_exist(buffer, ret);
-            break;
-        }
+    int user_cmd = KV_CMD_ERORR;
+    //批量指令由多个请求流水线发送实现，不通过二进制协议提供
+    if(req.engine < kv_engine_count && (req.opcode <= KV_BIN_EXIST || (req.opcode >= KV_BIN_UPSERT && req.opcode <= KV_BIN_GETDEL))) {
+        user_cmd = req.engine * KV_ENGINE_CMD_COUNT + req.opcode;
+    }
+    kv_slice tokens[3] = {
+        {NULL, 0},
+        {data + sizeof(kv_bin_header), key_len},
+        {data + sizeof(kv_bin_header) + key_len, value_len},
+    };
+    int ret = kv_execute_cmd(user_cmd, tokens, 3, out, KV_PROTO_BIN);
+    return (ret == 0) ? (int)used : -1;
+}
+/*------------二进制协议------------*/
 
-        case KV_CMD_SHSET:{
-            int ret = kv_shash_set(&kv_shash, tokens);
-            msg_len = kv_setbuffer_set(buffer, ret);
-            break;
-        }
 
-        case KV_CMD_SHGET:{
-            char *value = kv_shash_get(&kv_shash, tokens);
-            msg_len = kv_setbuffer_get(buffer, max_buffer_len, value);
-            break;
-        }
+/*------------memcached文本协议------------*/
+//memcached协议的key存放在KV_MC_ENGINE（跳表）中，与SKSET/SKGET等指令读写同一份数据
+//set按memcached的语义覆盖已有的key，由引擎的upsert直接替换value；exptime只做格式检查，不会过期
+//value的flags保存在value头部；gets返回的cas恒为0，不支持cas指令
 
-        case KV_CMD_SHDELETE:{
-            int ret = kv_shash_delete(&kv_shash, tokens);
-            msg_len = kv_setbuffer_delete(buffer, ret);
-            break;
+//解析十进制无符号整数，超过max或格式错误返回-1
+static int kv_mc_number(kv_slice token, unsigned long long max, unsigned long long *num) {
+    unsigned long long n = 0;
+    if(token.len == 0 || token.len > 20) {
+        return -1;
+    }
+    for(size_t i = 0; i < token.len; i++) {
+        if(token.data[i] < '0' || token.data[i] > '9') {
+            return -1;
         }
-
-        case KV_CMD_SHCOUNT:{
-            int count = kv_shash_count(&kv_shash);
-            msg_len = kv_setbuffer_count(buffer, count);
-            break;
+        n = n * 10 + (token.data[i] - '0');
+        if(n > max) {
+            return -1;
         }
+    }
+    *num = n;
+    return 0;
+}
 
-        case KV_CMD_SHEXIST:{
-            int ret = kv_shash_exist(&kv_shash, tokens);
-            msg_len = kv_setbuffer_exist(buffer, ret);
-            break;
-        }
+//把固定的回复追加到out，调用前已预留KV_MC_REPLY_RESERVE字节
+static void kv_mc_reply(kv_out *out, const char *msg) {
+    size_t msg_len = strlen(msg);
+    memcpy(out->buf.data + out->buf.len, msg, msg_len);
+    out->buf.len += msg_len;
+}
 
-        case KV_CMD_DHSET:{
-            int ret = kv_dhash_set(&kv_dhash, tokens);
-            msg_len = kv_setbuffer_set(buffer, ret);
-            break;
+//get/gets：[p, end)为指令名之后的key列表，所有key在同一次读锁内查找，命中的value依次写入回复
+static int kv_mc_get(kv_out *out, const char *p, const char *end, int cas) {
+    kv_slice tokens[2] = {{NULL, 0}, {NULL, 0}};//与引擎接口一致，tokens[1]为key
+    const kv_engine_ops *engine = kv_engines[KV_MC_ENGINE];
+    int ret = 0;
+    kv_engine_lock(KV_MC_CMD(KV_CMD_GET));
+    while((p = kv_scan_space(p, end, 0)) < end) {
+        const char *key = p;
+        p = kv_scan_space(p, end, 1);
+        if(p - key > KV_MC_KEY_MAX) {//不合法的key不可能存在
+            continue;
         }
-
-        case KV_CMD_DHGET:{
-            char *value = kv_dhash_get(&kv_dhash, tokens);
-            msg_len = kv_setbuffer_get(buffer, max_buffer_len, value);
-            break;
+        tokens[1].data = key;
+        tokens[1].len = p - key;
+        char *value = engine->get(engine->store, tokens);
+        if(value == NULL) {
+            continue;
         }
-
-        case KV_CMD_DHDELETE:{
-            int ret = kv_dhash_delete(&kv_dhash, tokens);
-            msg_len = kv_setbuffer_delete(buffer, ret);
+        if(kv_buf_reserve(&out->buf, KV_MC_REPLY_RESERVE) != 0) {
+            ret = -1;
             break;
         }
-
-        case KV_CMD_DHCOUNT:{
-            int count = kv_dhash_count(&kv_dhash);
-            msg_len = kv_setbuffer_count(buffer, count);
+        int head = snprintf(out->buf.data + out->buf.len, KV_MC_REPLY_RESERVE, cas ? "VALUE %.*s %u %zu 0\r\n" : "VALUE %.*s %u %zu\r\n",
+            (int)tokens[1].len, key, kv_value_flags(value), kv_value_len(value));
+        size_t msg_len = kv_setbuffer_value(out, head, value, 1);
+        if(msg_len == 0) {
+            ret = -1;
             break;
         }
+        out->buf.len += msg_len;
+    }
+    kv_engine_unlock(KV_MC_CMD(KV_CMD_GET));
+    if(ret != 0 || kv_buf_reserve(&out->buf, KV_MC_REPLY_RESERVE) != 0) {
+        return -1;
+    }
+    kv_mc_reply(out, "END\r\n");
+    return 0;
+}
 
-        case KV_CMD_DHEXIST:{
-            int ret = kv_dhash_exist(&kv_dhash, tokens);
-            msg_len = kv_setbuffer_exist(buffer, ret);
-            break;
-        }
+//set/add：add只在key不存在时插入
+static const char *kv_mc_store(kv_slice key, kv_slice value, unsigned int flags, int add) {
+    kv_slice tokens[3] = {{NULL, 0}, key, value};
+    const kv_engine_ops *engine = kv_engines[KV_MC_ENGINE];
+    kv_engine_lock(KV_MC_CMD(KV_CMD_SET));
+    int ret = add ? engine->set(engine->store, tokens) : engine->upsert(engine->store, tokens, NULL);
+    if(ret >= 0) {
+        //刚插入的value只被引擎持有，持写锁时设置flags不会与其他线程的读取冲突
+        kv_value_set_flags(engine->get(engine->store, tokens), flags);
+    }
+    kv_engine_unlock(KV_MC_CMD(KV_CMD_SET));
+    if(ret >= 0) {
+        return "STORED\r\n";
+    }
+    return (ret == -2) ? "NOT_STORED\r\n" : "SERVER_ERROR out of memory storing object\r\n";
+}
 
-        case KV_CMD_SKSET:{
-            int ret = kv_skiplist_set(&kv_skiplist, tokens);
-            msg_len = kv_setbuffer_set(buffer, ret);
-            break;
-        }
+//delete
+static const char *kv_mc_delete(kv_slice key) {
+    kv_slice tokens[2] = {{NULL, 0}, key};
+    const kv_engine_ops *engine = kv_engines[KV_MC_ENGINE];
+    kv_engine_lock(KV_MC_CMD(KV_CMD_DELETE));
+    int ret = engine->del(engine->store, tokens);
+    kv_engine_unlock(KV_MC_CMD(KV_CMD_DELETE));
+    if(ret == 0) {
+        return "DELETED\r\n";
+    }
+    return (ret == -2) ? "NOT_FOUND\r\n" : "SERVER_ERROR delete fail\r\n";
+}
 
-        case KV_CMD_SKGET:{
-            char *value = kv_skiplist_get(&kv_skiplist, tokens);
-            msg_len = kv_setbuffer_get(buffer, max_buffer_len, value);
-            break;
+//先确认指令行和set的数据块都已完整到达再执行，数据不完整时下次到达更多数据后重新解析，不修改缓冲区
+//格式错误的指令行按memcached的方式回复CLIENT_ERROR或ERROR后跳过，不关闭连接
+int kv_mc_protocol(const char *data, size_t len, kv_out *out, size_t *swallow) {
+    const char *nl = (const char *)memchr(data, '\n', len);
+    if(nl == NULL) {
+        return 0;
+    }
+    size_t used = nl - data + 1;//指令行占用的字节数
+    const char *end = (nl > data && *(nl - 1) == '\r') ? nl - 1 : nl;
+    kv_slice tokens[KV_MC_TOKENS];
+    int num_tokens = kv_split_tokens(data, end - data, tokens, KV_MC_TOKENS);
+    if(kv_buf_reserve(&out->buf, KV_MC_REPLY_RESERVE) != 0) {
+        return -1;
+    }
+    if(num_tokens == 0) {
+        kv_mc_reply(out, "ERROR\r\n");
+        return (int)used;
+    }
+    int noreply = (num_tokens <= KV_MC_TOKENS && kv_token_is(tokens[num_tokens - 1], "noreply", 0));
+    const char *msg = NULL;
+
+    if(kv_token_is(tokens[0], "get", 0) || kv_token_is(tokens[0], "gets", 0)) {
+        if(num_tokens == 1) {//没有key，memcached回复ERROR
+            kv_mc_reply(out, "ERROR\r\n");
+            return (int)used;
         }
-        
-        case KV_CMD_SKDELETE:{
-            int ret = kv_skiplist_delete(&kv_skiplist, tokens);
-            msg_len = kv_setbuffer_delete(buffer, ret);
-            break;
+        if(kv_mc_get(out, tokens[0].data + tokens[0].len, end, tokens[0].len == 4) != 0) {
+            return -1;
         }
-
-        case KV_CMD_SKCOUNT:{
-            int count = kv_skiplist_count(&kv_skiplist);
-            msg_len = kv_setbuffer_count(buffer, count);
-            break;
+        return (int)used;
+    }
+    else if(kv_token_is(tokens[0], "set", 0) || kv_token_is(tokens[0], "add", 0)) {
+        unsigned long long flags = 0, exptime = 0, bytes = 0;
+        if(num_tokens != 5 + noreply) {
+            kv_mc_reply(out, "CLIENT_ERROR bad command line format\r\n");
+            return (int)used;
         }
-
-        case KV_CMD_SKEXIST:{
-            int ret = kv_skiplist_exist(&kv_skiplist, tokens);
-            msg_len = kv_setbuffer_exist(buffer, ret);
-            break;
+        kv_slice expire = tokens[3];
+        if(*expire.data == '-') {//负数的exptime表示立即过期，同样只检查格式
+            expire.data++;
+            expire.len--;
         }
-        
-        case KV_CMD_ERORR:{
-            msg_len = strlen(RES_MSG[KV_RES_ERROR]);
-            strncpy(buffer, RES_MSG[KV_RES_ERROR], msg_len);
-            break;
+        if(kv_mc_number(tokens[2], 0xffffffffULL, &flags) != 0 || kv_mc_number(expire, 0xffffffffULL, &exptime) != 0
+            || kv_mc_number(tokens[4], ~0ULL, &bytes) != 0) {
+            kv_mc_reply(out, "CLIENT_ERROR bad command line format\r\n");
+            return (int)used;
         }
-
-        default:{
-            msg_len = strlen(RES_MSG[KV_RES_ERROR]);
-            strncpy(buffer, RES_MSG[KV_RES_ERROR], msg_len);
+        if(bytes > KV_MC_VALUE_MAX) {//与memcached相同，回复错误后丢弃数据块和结尾的\r\n，连接继续可用
+            *swallow = bytes + 2;
+            kv_mc_reply(out, "SERVER_ERROR object too large for cache\r\n");
+            return (int)used;
+        }
+        if(len < used + bytes + 2) {
+            return 0;
+        }
+        kv_slice value = {data + used, bytes};
+        used += bytes + 2;
+        if(value.data[bytes] != '\r' || value.data[bytes + 1] != '\n') {
+            msg = "CLIENT_ERROR bad data chunk\r\n";
+        }
+        else if(tokens[1].len > KV_MC_KEY_MAX) {
+            msg = "CLIENT_ERROR bad command line format\r\n";
+        }
+        else {
+            msg = kv_mc_store(tokens[1], value, (unsigned int)flags, kv_token_is(tokens[0], "add", 0));
         }
     }
-    return msg_len;
-}
\ No newline at end of file
+    else if(kv_token_is(tokens[0], "delete", 0)) {
+        if(num_tokens != 2 + noreply || tokens[1].len > KV_MC_KEY_MAX) {
+            kv_mc_reply(out, "CLIENT_ERROR bad command line format\r\n");
+            return (int)used;
+        }
+        msg = kv_mc_delete(tokens[1]);
+    }
+    else if(kv_token_is(tokens[0], "version", 0)) {
+        msg = "VERSION 1.6.0\r\n";
+        noreply = 0;
+    }
+    else {
+        msg = "ERROR\r\n";
+        noreply = 0;
+    }
+    if(!noreply) {
+        kv_mc_reply(out, msg);
+    }
+    return (int)used;
+}
+/*------------memcached文本协议------------*/
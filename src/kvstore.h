@@ -4,6 +4,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+//引用计数的value
+#include "value.h"
 
 //六种存储引擎的数据结构
 #include "array.h"
@@ -13,23 +19,175 @@
 #include "shash.h"
 #include "dhash.h"
 
-#define MAX_TOKENS 32//用户指令最大的拆分数量
+#define MAX_TOKENS 512//用户指令最大的拆分数量，批量指令一次最多255对key value
+#define KV_ENGINE_MAX 8//可以注册的存储引擎数量上限，包括内置的六种
+
+//KV存储引擎，定义在kvstore.c中，由所有reactor线程共享
+//并发模型：每个引擎一把读写锁，查找/计数/存在类指令持读锁并发执行，插入/删除类指令持写锁独占执行
+//加锁只发生在kv_protocol内部，引擎本身的实现不感知多线程
+extern kv_array_t kv_array;
+extern kv_rbtree_t kv_rbtree;
+extern kv_btree_t kv_btree;
+extern kv_skiplist_t kv_skiplist;
+extern kv_shash_t kv_shash;
+extern kv_dhash_t kv_dhash;
 
-//KV存储引擎
-kv_array_t kv_array;
-kv_rbtree_t kv_rbtree;
-kv_btree_t kv_btree;
-kv_skiplist_t kv_skiplist;
-kv_shash_t kv_shash;
-kv_dhash_t kv_dhash;
+//存储引擎的操作表，每个引擎提供相同的六个操作，由kv_protocol按指令编号找到引擎后调用
+//指令名为prefix加上操作名（SET/GET/DELETE/COUNT/EXIST/MGET/MSET/MDEL/UPSERT/GETSET/GETDEL），也可以用 引擎编号.操作名 指定引擎
+//批量指令由kv_protocol对每个key调用一次set/get/del实现，GETSET和GETDEL由upsert、get和del组合，引擎不需要额外的接口
+//同一种数据结构可以用不同的store和param注册多次，作为调优参数不同的变体与原引擎对比，内置引擎中只有B树和跳表有可调的参数
+typedef struct kv_engine_ops_s {
+    const char *name;//引擎名，用于日志
+    const char *prefix;//指令名前缀，不能与已注册的引擎相同
+    void *store;//引擎的数据结构，由注册者提供，生命周期覆盖整个进程
+    int param;//传给init的参数：B树的阶数、跳表的最大层数，没有可调参数的引擎忽略此值
+    int (*init)(void *store, int param);
+    int (*desy)(void *store);
+    int (*set)(void *store, kv_slice *tokens);//返回0成功，-2已经存在，-1失败
+    char *(*get)(void *store, kv_slice *tokens);//返回value，不存在返回NULL
+    int (*del)(void *store, kv_slice *tokens);//返回0成功，-2不存在，-1失败
+    int (*count)(void *store);
+    int (*exist)(void *store, kv_slice *tokens);//返回1存在，0不存在
+    int (*upsert)(void *store, kv_slice *tokens, char **old);//返回0插入，1覆盖，-1失败，old不为NULL时返回旧value的引用
+} kv_engine_ops;
 
-//初始化存储引擎
+//注册存储引擎，必须在kv_engine_init之前调用，内置引擎已占用编号0~5
+//返回引擎编号，前缀重复或引擎数量达到KV_ENGINE_MAX时返回-1
+int kv_engine_register(const kv_engine_ops *ops);
+
+//初始化所有已注册的存储引擎
 int kv_engine_init(void);
 
-//销毁存储引擎
+//销毁所有已注册的存储引擎
 int kv_engine_desy(void);
 
-//实现kv存储协议
-size_t kv_protocol(char *buffer, size_t max_buffer_len);
+//可增长的缓冲区，用于连接的读写缓冲区，kv存储协议的回复追加在其中
+typedef struct kv_buf_s {
+    char *data;
+    size_t len;//有效数据长度
+    size_t size;//已分配的长度
+} kv_buf;
+
+//回复中直接引用的value，发送时作为单独的一段iovec，不拷贝进缓冲区
+typedef struct kv_ref_s {
+    size_t pos;//value插入在buf数据中的位置
+    char *value;//持有value的一个引用，发送完成后释放
+} kv_ref;
+
+//连接的回复输出：buf中的字节与插入其中的value引用按位置交织成完整的回复流
+typedef struct kv_out_s {
+    kv_buf buf;
+    kv_ref *refs;//按pos递增排列
+    int nref;//有效引用数量
+    int ref_size;//refs已分配的数量
+    size_t ref_bytes;//所有引用的value总长度
+    size_t ref_sent;//refs[0]的value中已发送的字节数
+} kv_out;
+
+//保证buf在有效数据之后至少还有need字节的空间，空间不足时按倍数扩容，返回0成功，-1内存不足
+int kv_buf_reserve(kv_buf *buf, size_t need);
+
+//在out当前位置插入value的引用，成功时持有value的一个引用
+int kv_out_ref(kv_out *out, char *value);
+
+//out中尚未发送的字节数
+size_t kv_out_len(const kv_out *out);
+
+//把out中尚未发送的数据按顺序填入iov，最多iovcnt段，返回填入的段数
+//split不为0时长度不小于split的value单独成为一次发送：位于开头时只填入它自己，否则在它之前截断
+int kv_out_iov(const kv_out *out, struct iovec *iov, int iovcnt, size_t split);
+
+//out开头尚未发送的数据是引用的value时返回该value，否则返回NULL
+char *kv_out_head_ref(const kv_out *out);
+
+//从out开头去掉已发送的len字节，释放已发送完的value引用
+void kv_out_consume(kv_out *out, size_t len);
+
+//释放out中所有的value引用和引用数组，buf由调用者处理
+void kv_out_reset(kv_out *out);
+
+//连接使用的协议，决定指令的切分方式和回复的编码
+typedef enum kv_proto_e {
+    KV_PROTO_NONE = 0,//尚未收到数据，由第一个字节确定
+    KV_PROTO_TEXT,//按行的文本协议，参数以空格分隔
+    KV_PROTO_RESP,//RESP2，指令为批量字符串数组，参数带长度前缀，可以包含空格和换行
+    KV_PROTO_MC,//memcached文本协议，只用于memcached端口上接收的连接
+    KV_PROTO_BIN,//定长头部的二进制协议，第一个字节为KV_BIN_REQ
+} kv_proto;
+
+#define KV_BIN_REQ 0xA7//二进制协议请求头的magic，不是可打印字符，不会与文本协议和RESP的第一个字节混淆
+#define KV_BIN_RES 0xA8//二进制协议回复头的magic
+#define KV_BIN_KEY_MAX 1024//二进制协议key的最大长度
+#define KV_BIN_VALUE_MAX (1024 * 1024 * 8)//二进制协议value的最大长度
+
+//二进制协议的定长头部，请求和回复格式相同，头部之后依次是key_len字节的key和value_len字节的value
+//多字节字段为网络字节序，指令由opcode和engine直接确定，不需要拆分和比较指令名
+typedef struct kv_bin_header_s {
+    uint8_t magic;//请求为KV_BIN_REQ，回复为KV_BIN_RES
+    uint8_t opcode;//kv_bin_op
+    uint8_t engine;//kv_bin_engine
+    uint8_t status;//回复的kv_bin_status，请求中为0
+    uint32_t key_len;//回复中为0
+    uint32_t value_len;//get回复中为value的长度，count回复中为4，之后是网络字节序的数量
+    uint32_t opaque;//请求id，回复原样带回，客户端按opaque而不是回复的顺序匹配请求
+} kv_bin_header;
+
+//二进制协议的操作，与每个存储引擎的指令顺序一致，批量指令（5~7）不通过二进制协议提供
+typedef enum kv_bin_op_e {
+    KV_BIN_SET = 0,
+    KV_BIN_GET,
+    KV_BIN_DELETE,
+    KV_BIN_COUNT,
+    KV_BIN_EXIST,
+    KV_BIN_UPSERT = 8,//回复OK
+    KV_BIN_GETSET,//回复中为旧value，key原来不存在时为NOT_FOUND
+    KV_BIN_GETDEL,//回复中为删除的value
+} kv_bin_op;
+
+//二进制协议的存储引擎编号，即内置引擎注册的编号，kv_engine_register注册的引擎依次使用之后的编号
+typedef enum kv_bin_engine_e {
+    KV_BIN_ARRAY = 0,
+    KV_BIN_RBTREE,
+    KV_BIN_BTREE,
+    KV_BIN_SHASH,
+    KV_BIN_DHASH,
+    KV_BIN_SKIPLIST,
+} kv_bin_engine;
+
+//二进制协议的回复状态
+typedef enum kv_bin_status_e {
+    KV_BIN_OK = 0,//成功，exist表示key存在
+    KV_BIN_NOT_FOUND,//key不存在
+    KV_BIN_EXISTS,//set的key已经存在
+    KV_BIN_FAIL,//引擎执行失败
+    KV_BIN_BAD_REQUEST,//opcode或engine不合法
+} kv_bin_status;
+
+//判断msg是否为只读的查找指令，即各存储引擎的get、exist和mget，UDP只执行这类指令
+int kv_lookup_command(const char *msg, size_t len);
+
+//实现kv存储协议，可被多个reactor线程同时调用
+//msg为一条长度为len的完整指令，不需要以'\0'结尾，回复追加到out中，返回0成功，-1表示内存不足无法写入回复
+int kv_protocol(const char *msg, size_t len, kv_out *out);
+
+//按空格拆分[data, data + len)，最多把max个参数存入tokens，参数指向data中的原位置，返回参数总数
+//编译时启用AVX2或SSE2时每次比较32或16个字节查找分隔符
+int kv_split_tokens(const char *data, size_t len, kv_slice *tokens, int max);
+
+//执行已拆分的指令，回复按proto编码后追加到out中，返回值与kv_protocol相同
+int kv_execute(kv_slice *tokens, int num_tokens, kv_out *out, int proto);
+
+//从data开头解析一条RESP指令，参数指向data中批量字符串的内容，最多保存max_tokens个，不修改data
+//返回指令占用的字节数，数据不完整返回0，格式错误返回-1
+int kv_resp_parse(const char *data, size_t len, kv_slice *tokens, int max_tokens, int *num_tokens);
+
+//从data开头解析并执行一条二进制协议请求，回复追加到out中
+//返回请求占用的字节数，数据不完整返回0，-1表示magic错误、长度超过上限或内存不足，需要关闭连接
+int kv_bin_protocol(const char *data, size_t len, kv_out *out);
+
+//从data开头解析并执行一条memcached文本协议指令（get/gets/set/add/delete/version），回复追加到out中
+//set的数据块超过上限时回复SERVER_ERROR，只消耗指令行，通过swallow返回之后还需要丢弃的数据块字节数
+//返回指令占用的字节数，数据不完整返回0，-1表示内存不足，需要关闭连接
+int kv_mc_protocol(const char *data, size_t len, kv_out *out, size_t *swallow);
 
 #endif
\ No newline at end of file
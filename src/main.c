@@ -2,6 +2,7 @@
     主要包含reactor模式的实现
     调用kv存储引擎
 */
+#define _GNU_SOURCE//accept4、CPU_SET与pthread_attr_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,16 +10,64 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <linux/errqueue.h>
 
 #include "kvstore.h"
+#include "timer.h"
 
+//是否编译io_uring网络后端，开启后需要链接liburing（-luring），运行时通过-b uring选择
+#ifndef ENABLE_IO_URING
+#define ENABLE_IO_URING 0
+#endif
 
-#define max_buffer_len 1024//读写buffer长度
+#if ENABLE_IO_URING
+#include <poll.h>
+#include <liburing.h>
+#endif
+
+
+#define max_buffer_len 1024//连接读写缓冲区的初始长度，也是缓冲池中缓冲区的长度
+#define max_command_len (1024 * 1024 * 16)//单条指令的最大长度，读缓冲区最多扩容到此长度
+#define max_wbuffer_len (max_buffer_len * 4)//单个连接待发送回复的默认上限，可用-o修改，流水线中多条指令的回复合并到一次发送
+#define buffer_pool_size 1024//每个reactor的缓冲池最多缓存的空闲缓冲区数量
+#define send_iov_max 64//一次sendmsg最多发送的iovec段数
+#define fairness_budget 1024//epoll后端每个连接每轮事件循环最多执行的指令数默认值，可用-f修改，0表示不限
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
 #define epoll_events_size 1024//epoll就绪集合大小
 #define connblock_size 1024//单个连接块存储的连接数量
+#define connblock_init_count 16//连接表第一级数组的初始长度，不够时按倍数扩容
 #define listen_port_count 1//监听端口数
+#define udp_batch 64//recvmmsg一次接收的数据报数量
+#define udp_packet_len 1400//UDP数据报的最大长度，包括帧头，与memcached相同，避免IP分片
+#define udp_header_len 8//memcached UDP帧头：请求id、序号、数据报总数、保留字段，各2字节，网络字节序
+#define udp_send_max 256//sendmmsg一次发送的数据报数量，也是单条回复最多拆分的数据报数量
+#define listen_backlog 1024//listen的全连接队列长度默认值，可用-l修改，实际长度不超过内核的net.core.somaxconn
+
+#if ENABLE_IO_URING
+#define uring_entries 4096//io_uring提交队列长度
+#define uring_buf_count 4096//provided buffer ring中的缓冲区数量，必须为2的幂
+#define uring_buf_group 0//provided buffer ring的组号
+#define uring_backlog_limit (max_buffer_len * 16)//rbuffer放不下的已接收数据超过此值时暂停接收
+#define uring_accept_retry_ms 100//fd耗尽时等待此毫秒数后再重新提交accept
+#endif
 
 /*------------回调函数声明------------*/
 typedef int (*ZV_CALLBACK)(int fd, int events, void *arg);
@@ -28,86 +77,268 @@ int accept_cb(int fd, int events, void *arg);
 int recv_cb(int fd, int events, void *arg);
 //发送数据
 int send_cb(int fd, int events, void *arg);
+//接收UDP查询
+int udp_cb(int fd, int events, void *arg);
 /*------------回调函数声明------------*/
 
 
 /*------------数据结构定义------------*/
+//MSG_ZEROCOPY发送后仍被内核引用的value，收到该次发送的完成通知后释放
+typedef struct zv_zc_pin_s{
+    unsigned int seq;//发送序号，内核按连接从0开始为每次成功的MSG_ZEROCOPY发送编号
+    char *value;//持有value的一个引用
+}zv_zc_pin;
+
 //描述单个连接的结构体，组织在内存连接块中
 typedef struct zv_connect_s
 {
     int fd;//本连接的客户端fd
-    char rbuffer[max_buffer_len];
-    size_t rcount;//读起始位置
+    //读写缓冲区在连接有数据时才从缓冲池取得，连接空闲时归还，大指令和大回复时扩容
+    kv_buf rbuffer;//rbuffer.len为读起始位置
+    size_t rchecked;//rbuffer开头已确认不含'\n'的长度，大指令分多次到达时不必重复扫描
+    int proto;//连接使用的协议，kv_proto，memcached端口的连接为memcached协议，其他连接由收到的第一个字节确定：'*'为RESP，KV_BIN_REQ为二进制协议，否则为文本协议
+    size_t mc_swallow;//memcached协议中超过上限的set数据块还需要丢弃的字节数
+
+    kv_out wbuffer;//回复输出，缓冲区中的字节与引用的value交织，用sendmsg一次发出
 
-    char wbuffer[max_buffer_len];
-    size_t wcount;//写起始位置
+    int zerocopy;//是否已开启SO_ZEROCOPY
+    unsigned int zc_seq;//下一次MSG_ZEROCOPY发送的序号
+    zv_zc_pin *pins;//等待完成通知的value
+    int npin;
+    int pin_size;
 
     size_t next_len;//下一次读数据的长度
     //事件处理回调函数
     ZV_CALLBACK cb;
+    int quota;//本次调度中还可以执行的指令数，-1表示不限
+    int pending;//是否在待处理队列中
+
+    zv_timer idle_timer;//空闲超时定时任务，只在连接建立和到期时操作时间轮
+    uint64_t last_active;//最近一次收发数据的时间，单位毫秒
+
+#if ENABLE_IO_URING
+    unsigned int gen;//连接代数，每次accept加1，用于丢弃fd被复用前提交的请求的完成事件
+    size_t wsending;//已提交但尚未完成的发送字节数，完成前wbuffer的这部分不能移动
+    struct zv_uring_msg_s *wmsg;//发送进行中的msghdr和iovec，内核在发送完成前一直读取
+    char *backlog;//rbuffer放不下的已接收数据
+    size_t backlog_len;
+    int recv_armed;//multishot recv是否仍在内核中生效
+    int recv_cancel;//是否已经因backlog过多请求取消multishot recv
+    int closing;//已请求关闭但发送仍在进行，等发送的完成事件到达后再关闭fd
+#endif
 }zv_connect;
 
-//存储连接的内存块的索引链表节点
-typedef struct zv_connblock_index_s{
-    struct zv_connect_s *block;//指向此链表节点所代表的内存块(连接数组)
-    struct zv_connblock_index_s *next;//指向代表下一个内存块的链表节点
-}zv_connblock_index;
+//连接缓冲区池，每个reactor独占一个，无需加锁
+//只缓存初始长度的缓冲区，扩容过的缓冲区归还时直接释放
+typedef struct zv_buffer_pool_s{
+    char *free_list;//空闲缓冲区链表，每个空闲缓冲区的开头存放下一个空闲缓冲区的地址
+    int count;//池中空闲缓冲区的数量
+}zv_buffer_pool;
+
+//一条回复中的一个UDP数据报，数据在发送前都存放在zv_udp.reply中，记录偏移以便reply扩容
+typedef struct zv_udp_dgram_s{
+    int req;//对应的请求在本批接收中的下标，用于取得客户端地址
+    size_t off;//数据在reply中的偏移
+    size_t len;
+    unsigned char hdr[udp_header_len];
+}zv_udp_dgram;
+
+//UDP查询的批量收发状态，每个reactor一个
+typedef struct zv_udp_s{
+    struct mmsghdr rmsgs[udp_batch];
+    struct iovec riov[udp_batch];
+    struct sockaddr_storage addrs[udp_batch];
+    char rbufs[udp_batch][udp_packet_len];
+    kv_out out;//执行指令的回复
+    kv_buf reply;//本批所有回复平铺后的数据
+    zv_udp_dgram dgrams[udp_send_max];
+    int ndgram;
+    struct mmsghdr smsgs[udp_send_max];
+    struct iovec siov[udp_send_max][2];
+}zv_udp;
+
+//网络事件后端
+typedef enum zv_backend_e{
+    ZV_BACKEND_EPOLL = 0,//epoll反应堆
+    ZV_BACKEND_URING,//io_uring，需要ENABLE_IO_URING
+}zv_backend;
+
+//服务端启动配置，由命令行参数解析得到，所有reactor线程共享且只读
+typedef struct zv_config_s{
+    int port;//监听起始端口
+    int reactor_count;//reactor线程数量，默认等于在线CPU核数
+    int edge_triggered;//客户端连接是否使用边沿触发，边沿触发下回调需要一直读写到EAGAIN
+    int backend;//网络事件后端，zv_backend
+    size_t zerocopy;//epoll后端中长度不小于此值的value用MSG_ZEROCOPY发送，0表示不使用
+    const char *unix_path;//AF_UNIX监听套接字的路径，NULL表示不监听
+    int unix_fd;//AF_UNIX监听套接字，由主线程创建后注册到所有reactor，-1表示不监听
+    uint64_t idle_timeout;//连接超过此毫秒数没有收发数据时关闭，0表示不超时
+    int backlog;//监听套接字的全连接队列长度
+    size_t output_limit;//单个连接待发送回复的上限，达到后暂停执行指令和读取数据，直到回复发出
+    int busy_poll;//epoll后端阻塞等待之前忙轮询的微秒数，同时设置到客户端套接字的SO_BUSY_POLL，0表示不忙轮询
+    int cpus[CPU_SETSIZE];//reactor绑定的CPU列表，第i个reactor绑定cpus[i % cpu_count]
+    int cpu_count;//0表示不绑核
+    int fairness;//epoll后端每个连接每轮最多执行的指令数，用完后让出给其他连接，0表示不限
+    int udp_port;//UDP查询端口，0表示不监听
+    int mc_port;//memcached文本协议端口，0表示不监听
+    int verbose;//是否打印每个连接的建立、关闭和空闲超时，默认不打印，避免在reactor线程上格式化输出
+}zv_config;
 
 //反应堆结构体
+//每个reactor线程独占一个reactor：独立的epoll、SO_REUSEPORT监听套接字和连接块，线程间不共享连接
 typedef struct zv_reactor_s{
     int epfd;//epoll文件描述符
-    struct zv_connblock_index_s *blockheader;//连接块链表的第一个节点
-    int blkcnt;//现有的连接块的总数
+    //以fd为下标的两级连接表：blocks[fd / connblock_size]指向存储connblock_size个连接的连接块
+    //连接块在其中第一个fd出现时才分配，查找连接只需两次下标访问
+    struct zv_connect_s **blocks;
+    int blkcnt;//第一级数组的长度
+    struct zv_buffer_pool_s pool;//连接缓冲区池
+    struct zv_udp_s *udp;//UDP查询的收发状态，开启UDP时才分配
+    int mc_fd;//本线程memcached端口的监听套接字，-1表示不监听，accept时据此确定连接的协议
+    int spare_fd;//预留的fd，fd耗尽时关闭它腾出位置来接受并关闭排队的连接，-1表示未能预留
+    //指令预算用完而暂停的连接fd，在本轮其他就绪连接之后继续执行，存在待处理连接时epoll_wait不阻塞
+    int *pending;
+    int npending;
+    int pending_size;
+
+    int id;//reactor编号
+    const struct zv_config_s *conf;//启动配置
+
+    zv_timer_wheel timers;//定时任务时间轮，到期时间决定事件循环的等待超时
+    uint64_t now;//最近一次等待返回时的时间，单位毫秒，本轮事件处理中都使用此时间
+
+#if ENABLE_IO_URING
+    struct io_uring ring;
+    struct io_uring_buf_ring *buf_ring;//multishot recv使用的provided buffer ring
+    char *bufs;//buffer ring中各缓冲区的内存，共uring_buf_count * max_buffer_len字节
+    unsigned int cqe_flags;//当前正在分发的完成事件的flags，供回调读取缓冲区编号和IORING_CQE_F_MORE
+#endif
 }zv_reactor;
+
+//reactor线程的启动参数，reactor本身由线程自己分配
+typedef struct zv_thread_arg_s{
+    int id;//reactor编号
+    const struct zv_config_s *conf;//启动配置
+    pthread_t thread;
+}zv_thread_arg;
 /*------------数据结构定义------------*/
 
 
 /*------------功能函数声明------------*/
 //reactor初始化
-int init_reactor(zv_reactor *reactor);
+int init_reactor(zv_reactor *reactor, int id, const zv_config *conf);
 //reactor销毁
 void destroy_reactor(zv_reactor *reactor);
 //服务端初始化,将端口设置为listen状态
-int init_server(int port);
+int init_server(int port, int backlog);
+//创建AF_UNIX监听套接字，供同一主机上的客户端绕过TCP协议栈连接
+int init_unix_server(const char *path, int backlog);
+//创建UDP查询套接字，与TCP一样每个reactor一个，SO_REUSEPORT按客户端地址分散到各个线程
+int init_udp_server(int port);
 //将本地的listenfd添加进epoll
 int set_listener(zv_reactor *reactor, int listenfd, ZV_CALLBACK cb);
-//尾插法创建一个新的连接块
-int zv_create_connblock(zv_reactor *reactor);
-//根据fd从连接块中找到连接所在位置，通过整除与取余的方式
+//创建第blk_idx个连接块，第一级数组长度不够时先扩容
+int zv_create_connblock(zv_reactor *reactor, int blk_idx);
+//根据fd从连接表中找到连接所在位置，通过整除与取余的方式
 zv_connect *zv_connect_idx(zv_reactor *reactor, int fd);
+//从缓冲池为连接取得缓冲区
+int zv_buffer_get(zv_reactor *reactor, kv_buf *buf);
+//把连接的缓冲区归还到缓冲池
+void zv_buffer_put(zv_reactor *reactor, kv_buf *buf);
+//连接没有待处理的数据时归还读写缓冲区
+void zv_release_idle_buffers(zv_reactor *reactor, zv_connect *conn);
+//客户端连接注册到epoll时使用的触发模式
+uint32_t zv_epoll_mode(zv_reactor *reactor);
+//关闭TCP连接的Nagle算法
+int zv_set_nodelay(int fd);
+//开启客户端套接字的忙轮询
+void zv_set_busy_poll(zv_reactor *reactor, int fd);
+//关闭客户端连接并清理其连接结构体
+void zv_close_connect(zv_reactor *reactor, zv_connect *conn);
+//fd耗尽时借助预留的fd取出并关闭全连接队列中的连接
+int zv_accept_overflow(zv_reactor *reactor, int listenfd);
+//为连接设置本次调度的指令预算
+void zv_set_quota(zv_reactor *reactor, zv_connect *conn);
+//把预算用完的连接加入待处理队列
+int zv_schedule(zv_reactor *reactor, zv_connect *conn);
+//继续执行上一轮预算用完的连接
+void zv_run_pending(zv_reactor *reactor);
+//开始连接的空闲计时，到期时执行cb
+void zv_idle_start(zv_reactor *reactor, zv_connect *conn, zv_timer_cb cb);
+//检查空闲计时到期的连接是否真的空闲，期间有过收发时重新计时
+int zv_idle_expired(zv_reactor *reactor, zv_connect *conn);
+//epoll后端的空闲超时回调，关闭空闲连接
+void zv_idle_cb(void *ctx, void *data);
+//执行接收缓冲区中所有完整的指令，回复追加到发送缓冲区
+int zv_process_input(zv_connect *conn, size_t limit);
+//执行接收缓冲区中所有完整的RESP、memcached或二进制协议指令
+int zv_process_sized(zv_connect *conn, size_t limit);
+//直接发送发送缓冲区中的回复，只有内核发送缓冲区满时才需要等待写事件
+int zv_send_reply(zv_reactor *reactor, zv_connect *conn);
+//固定一次MSG_ZEROCOPY发送中的value，直到收到完成通知
+int zv_zerocopy_pin(zv_connect *conn, char *value);
+//读取套接字错误队列中的MSG_ZEROCOPY完成通知并释放对应的value
+int zv_zerocopy_reap(zv_connect *conn);
+//分配本线程的UDP收发状态
+int zv_udp_init(zv_reactor *reactor);
+//接收并执行一批UDP查询，返回接收的数据报数量
+int zv_udp_process(zv_reactor *reactor, int fd);
+//reactor线程的事件循环
+int zv_reactor_loop(zv_reactor *reactor);
+#if ENABLE_IO_URING
+//初始化本线程的io_uring和provided buffer ring
+int zv_uring_init(zv_reactor *reactor);
+//销毁本线程的io_uring
+void zv_uring_exit(zv_reactor *reactor);
+//为监听套接字提交multishot accept
+int zv_uring_set_listener(zv_reactor *reactor, int listenfd);
+//为UDP套接字提交multishot poll
+int zv_uring_set_udp(zv_reactor *reactor, int udpfd);
+//io_uring后端的事件循环
+int zv_uring_loop(zv_reactor *reactor);
+//io_uring后端的接收连接/接收数据/发送数据回调，events参数为完成事件的res
+int uring_accept_cb(int fd, int res, void *arg);
+int uring_recv_cb(int fd, int res, void *arg);
+int uring_send_cb(int fd, int res, void *arg);
+int uring_udp_cb(int fd, int res, void *arg);
+#endif
+//reactor线程入口
+void *zv_reactor_thread(void *arg);
+//解析CPU列表
+int zv_parse_cpus(zv_config *conf, const char *list);
+//解析命令行参数
+int zv_parse_args(zv_config *conf, int argc, char *argv[]);
 //运行KV存储协议
-int kv_run_while(int argc, char *argv[]);
+int kv_run_while(const zv_config *conf);
 /*------------功能函数声明------------*/
 
 
 /*------------功能函数实现------------*/
 //reactor初始化实现
-int init_reactor(zv_reactor *reactor) {
+int init_reactor(zv_reactor *reactor, int id, const zv_config *conf) {
     if(reactor == NULL) {
         return -1;
     }
     memset(reactor, 0, sizeof(zv_reactor));
+    reactor->id = id;
+    reactor->conf = conf;
     reactor->epfd = epoll_create(1);//int size
     if(reactor->epfd <= 0) {
         perror("init reactor->epfd error\n");
         return -1;
     }
 
-    //首先分配作为存储连接的内存块索引的链表节点
-    reactor->blockheader = (zv_connblock_index *)calloc(1, sizeof(zv_connblock_index));//分配1个连续的长度为sizeof(zv_connblock)的内存空间
-    if(reactor->blockheader == NULL) {
-        perror("reactor init : index node calloc fail\n");
-        return -1;
-    }
-    reactor->blockheader->next = NULL;
-    
-    //为索引链表节点指向的内存块分配能够存储connblock_size个连接的内存空间
-    reactor->blockheader->block = (zv_connect *)calloc(connblock_size, sizeof(zv_connect));
-    if(reactor->blockheader->block == NULL) {
-        perror("reactor init : memory block calloc fail\n");
+    //只分配连接表的第一级数组，连接块在用到时再分配
+    reactor->blocks = (zv_connect **)calloc(connblock_init_count, sizeof(zv_connect *));
+    if(reactor->blocks == NULL) {
+        perror("reactor init : connect table calloc fail\n");
         return -1;
     }
-    reactor->blkcnt = 1;
+    reactor->blkcnt = connblock_init_count;
+    reactor->mc_fd = -1;
+    reactor->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    reactor->now = zv_timer_now();
+    zv_timer_wheel_init(&reactor->timers, reactor->now);
     return 0;
 }
 
@@ -115,27 +346,71 @@ int init_reactor(zv_reactor *reactor) {
 void destroy_reactor(zv_reactor *reactor) {
     if(reactor) {
         close(reactor->epfd);//关闭epoll
-        zv_connblock_index *curblk = reactor->blockheader;
-        zv_connblock_index *nextblk = reactor->blockheader;
-        do {
-            curblk = nextblk;
-            nextblk = curblk->next;
-            if(curblk->block) {
-                free(curblk->block);
-                curblk->block = NULL;
+        if(reactor->spare_fd >= 0) {
+            close(reactor->spare_fd);
+        }
+        //释放所有连接块及连接仍持有的缓冲区
+        for(int blk_idx = 0; blk_idx < reactor->blkcnt; blk_idx++) {
+            zv_connect *block = reactor->blocks[blk_idx];
+            if(block == NULL) {
+                continue;
             }
-            if(curblk) {
-                free(curblk);
-                curblk = NULL;
+            for(int i = 0; i < connblock_size; i++) {
+                free(block[i].rbuffer.data);
+                kv_out_reset(&block[i].wbuffer);
+                free(block[i].wbuffer.buf.data);
+                for(int j = 0; j < block[i].npin; j++) {
+                    kv_value_unref(block[i].pins[j].value);
+                }
+                free(block[i].pins);
+#if ENABLE_IO_URING
+                free(block[i].backlog);
+                free(block[i].wmsg);
+#endif
             }
-        } while(nextblk != NULL);//释放连接块链表
+            free(block);
+        }
+        free(reactor->blocks);
+        reactor->blocks = NULL;
+        reactor->blkcnt = 0;
+        free(reactor->pending);
+        reactor->pending = NULL;
+        reactor->npending = 0;
+        reactor->pending_size = 0;
+        //释放缓冲池
+        while(reactor->pool.free_list) {
+            char *buf = reactor->pool.free_list;
+            reactor->pool.free_list = *(char **)buf;
+            free(buf);
+        }
+        reactor->pool.count = 0;
+        if(reactor->udp) {
+            kv_out_reset(&reactor->udp->out);
+            free(reactor->udp->out.buf.data);
+            free(reactor->udp->reply.data);
+            free(reactor->udp);
+            reactor->udp = NULL;
+        }
     }
 }
 
 //服务端初始化：将端口设置为listen状态，绑定成功后返回监听文件描述符
-int init_server(int port) {
+//每个reactor线程各自调用一次，SO_REUSEPORT使多个套接字可以绑定同一端口，由内核把新连接分散到各个线程
+//监听套接字为非阻塞，accept_cb一次取到EAGAIN为止
+int init_server(int port, int backlog) {
     //创建一个TCP套接字，AF_INET指定使用IPv4地址族，SOCK_STREAM面向连接的流套接字，0表默认协议，针对SOCK_STREAM操作系统会选择TCP协议
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sockfd < 0) {
+        perror("create socket fail\n");
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if(-1 == setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("setsockopt SO_REUSEPORT fail\n");
+        close(sockfd);
+        return -1;
+    }
     //sockaddr_in结构体变量，用来存储服务器的地址信息（IP地址和端口号等信息）
     struct sockaddr_in serveraddr;
     memset(&serveraddr, 0, sizeof(struct sockaddr_in));
@@ -149,72 +424,588 @@ int init_server(int port) {
         return -1;
     }
     //将端口设置为listen
-    listen(sockfd, 10);
+    if(-1 == listen(sockfd, backlog)) {
+        perror("listen fail\n");
+        close(sockfd);
+        return -1;
+    }
     printf("listen port : %d, sockfd = %d\n", port, sockfd);
     return sockfd;
 }
 
+//创建AF_UNIX流式监听套接字，路径上残留的旧套接字文件先删除
+//所有reactor共享这一个监听套接字，因此设置为非阻塞，没抢到连接的线程accept返回EAGAIN
+int init_unix_server(const char *path, int backlog) {
+    struct sockaddr_un serveraddr;
+    if(strlen(path) >= sizeof(serveraddr.sun_path)) {
+        fprintf(stderr, "unix socket path too long : %s\n", path);
+        return -1;
+    }
+    int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sockfd < 0) {
+        perror("create unix socket fail\n");
+        return -1;
+    }
+    memset(&serveraddr, 0, sizeof(serveraddr));
+    serveraddr.sun_family = AF_UNIX;
+    strcpy(serveraddr.sun_path, path);
+    unlink(path);
+    if(-1 == bind(sockfd, (struct sockaddr *)&serveraddr, sizeof(serveraddr))) {
+        perror("bind unix socket fail\n");
+        close(sockfd);
+        return -1;
+    }
+    if(-1 == listen(sockfd, backlog)) {
+        perror("listen unix socket fail\n");
+        close(sockfd);
+        unlink(path);
+        return -1;
+    }
+    printf("listen unix socket : %s, sockfd = %d\n", path, sockfd);
+    return sockfd;
+}
+
+//创建UDP查询套接字并绑定端口
+int init_udp_server(int port) {
+    int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sockfd < 0) {
+        perror("create udp socket fail\n");
+        return -1;
+    }
+    int opt = 1;
+    if(-1 == setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("setsockopt udp SO_REUSEPORT fail\n");
+        close(sockfd);
+        return -1;
+    }
+    struct sockaddr_in serveraddr;
+    memset(&serveraddr, 0, sizeof(struct sockaddr_in));
+    serveraddr.sin_family = AF_INET;
+    serveraddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serveraddr.sin_port = htons(port);
+    if(-1 == bind(sockfd, (struct sockaddr *)&serveraddr, sizeof(struct sockaddr))) {
+        perror("bind udp fail\n");
+        close(sockfd);
+        return -1;
+    }
+    printf("listen udp port : %d, sockfd = %d\n", port, sockfd);
+    return sockfd;
+}
+
 //将本地的listenfd添加进epoll
+//AF_UNIX监听套接字被所有reactor的epoll共享，EPOLLEXCLUSIVE使一个新连接只唤醒其中一个线程
 int set_listener(zv_reactor *reactor, int listenfd, ZV_CALLBACK cb) {
-    if(!reactor || !reactor->blockheader) {
-        perror("set_listener:invalid reactor or reactor->blockheader\n");
+    if(!reactor || !reactor->blocks || listenfd < 0) {
+        perror("set_listener:invalid reactor or reactor->blocks\n");
+        return -1;
+    }
+    //将服务端放进连接表，与事件循环使用同一种fd到连接的映射方式
+    zv_connect *conn = zv_connect_idx(reactor, listenfd);
+    if(conn == NULL) {
         return -1;
     }
-    //将服务端放进连接块
-    reactor->blockheader->block[listenfd].fd = listenfd;
-    reactor->blockheader->block[listenfd].cb = cb;//监听文件描述符触发的是读事件，回调函数是accept_cb
+    conn->fd = listenfd;
+    conn->cb = cb;//监听文件描述符触发的是读事件，回调函数是accept_cb
     //将服务端添加进epoll事件
     struct epoll_event ev;
     ev.data.fd = listenfd;
-    ev.events = EPOLLIN;//监听文件描述符关心的是读事件
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;//监听文件描述符关心的是读事件
     epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, listenfd, &ev);
     return 0;
 }   
 
-//尾插法创建一个新的连接块
-int zv_create_connblock(zv_reactor *reactor) {
-    if(!reactor) {
+//创建第blk_idx个连接块，第一级数组长度不够时按倍数扩容
+int zv_create_connblock(zv_reactor *reactor, int blk_idx) {
+    if(!reactor || blk_idx < 0) {
         return -1;
     }
-    //初始化新的连接块
-    zv_connblock_index *newblk = (zv_connblock_index *)calloc(1, sizeof(zv_connblock_index));
-    if(newblk == NULL) {
-        perror("new connblock : node calloc fail\n");
-        return -1;
+    if(blk_idx >= reactor->blkcnt) {
+        int blkcnt = reactor->blkcnt;
+        while(blkcnt <= blk_idx) {
+            blkcnt *= 2;
+        }
+        zv_connect **blocks = (zv_connect **)realloc(reactor->blocks, blkcnt * sizeof(zv_connect *));
+        if(blocks == NULL) {
+            perror("new connblock : connect table realloc fail\n");
+            return -1;
+        }
+        memset(blocks + reactor->blkcnt, 0, (blkcnt - reactor->blkcnt) * sizeof(zv_connect *));
+        reactor->blocks = blocks;
+        reactor->blkcnt = blkcnt;
     }
-    newblk->block = (zv_connect *)calloc(connblock_size, sizeof(zv_connect));
-    if(newblk->block == NULL) {
+    //初始化新的连接块
+    reactor->blocks[blk_idx] = (zv_connect *)calloc(connblock_size, sizeof(zv_connect));
+    if(reactor->blocks[blk_idx] == NULL) {
         perror("new connblock : memory block calloc fail\n");
         return -1;
     }
-    newblk->next = NULL;
-    //将新分配的块索引插入到索引链表的最后一个节点
-    zv_connblock_index *endblk = reactor->blockheader;
-    while(endblk->next != NULL) {
-        endblk = endblk->next;
-    }
-    endblk->next = newblk;
-    reactor->blkcnt++;//连接块数目+1
     return 0;
 }
 
 //根据fd找到该连接位于哪个连接块的第几个连接，返回存储该连接的结构体
-//若fd存在则返回其所属连接，若不存在则依照fd顺序存储的方式，返回一个其应该处于的空的连接结构体
+//若fd存在则返回其所属连接，若不存在则返回一个其应该处于的空的连接结构体，所在连接块不存在时先创建
+//fd直接作为下标，不依赖fd从3开始连续分配，多个reactor线程共享fd编号空间时各自的连接表可以是稀疏的
 zv_connect *zv_connect_idx(zv_reactor *reactor, int fd) {
-    if(!reactor) {
+    if(!reactor || fd < 0) {
         return NULL;
     }
-    //由于文件描述符按序分配且连接按序存储，前3个文件描述符已经分配给stdin\stdout\stderr
-    int blk_idx = (fd - 3) / connblock_size;
-    while(blk_idx >= reactor->blkcnt) {
-        zv_create_connblock(reactor);
+    int blk_idx = fd / connblock_size;
+    if(blk_idx >= reactor->blkcnt || reactor->blocks[blk_idx] == NULL) {
+        if(zv_create_connblock(reactor, blk_idx) != 0) {
+            return NULL;
+        }
+    }
+    return &reactor->blocks[blk_idx][fd % connblock_size];
+}
+
+//从缓冲池为连接取得缓冲区，连接已有缓冲区时直接返回，池为空时新分配
+int zv_buffer_get(zv_reactor *reactor, kv_buf *buf) {
+    if(buf->data) {
+        return 0;
+    }
+    zv_buffer_pool *pool = &reactor->pool;
+    if(pool->free_list) {
+        buf->data = pool->free_list;
+        pool->free_list = *(char **)buf->data;
+        pool->count--;
+    }
+    else {
+        buf->data = (char *)malloc(max_buffer_len);
+        if(buf->data == NULL) {
+            perror("connect buffer malloc fail\n");
+            return -1;
+        }
+    }
+    buf->size = max_buffer_len;
+    buf->len = 0;
+    return 0;
+}
+
+//把连接的缓冲区归还到缓冲池，扩容过的缓冲区或池已满时直接释放
+void zv_buffer_put(zv_reactor *reactor, kv_buf *buf) {
+    if(buf->data == NULL) {
+        return;
+    }
+    zv_buffer_pool *pool = &reactor->pool;
+    if(buf->size == max_buffer_len && pool->count < buffer_pool_size) {
+        *(char **)buf->data = pool->free_list;
+        pool->free_list = buf->data;
+        pool->count++;
+    }
+    else {
+        free(buf->data);
+    }
+    buf->data = NULL;
+    buf->len = 0;
+    buf->size = 0;
+}
+
+//连接的读写缓冲区都没有待处理的数据时归还到缓冲池，大量空闲连接只占用连接结构体本身的内存
+void zv_release_idle_buffers(zv_reactor *reactor, zv_connect *conn) {
+    if(conn->rbuffer.len == 0 && kv_out_len(&conn->wbuffer) == 0) {
+        zv_buffer_put(reactor, &conn->rbuffer);
+        zv_buffer_put(reactor, &conn->wbuffer.buf);
+        kv_out_reset(&conn->wbuffer);
+        conn->rchecked = 0;
+    }
+    if(conn->npin == 0 && conn->pins) {
+        free(conn->pins);
+        conn->pins = NULL;
+        conn->pin_size = 0;
+    }
+}
+
+//客户端连接的触发模式，监听套接字始终使用水平触发
+uint32_t zv_epoll_mode(zv_reactor *reactor) {
+    return reactor->conf->edge_triggered ? EPOLLET : 0;
+}
+
+//关闭Nagle算法：回复在一次sendmsg中整体发出，不需要内核再合并小包，等待合并只会增加延迟
+int zv_set_nodelay(int fd) {
+    int opt = 1;
+    return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+}
+
+//SO_BUSY_POLL使套接字上的阻塞读在没有数据时先轮询网卡队列，SO_PREFER_BUSY_POLL使网卡中断在忙轮询期间保持关闭
+//超过net.core.busy_read的值需要CAP_NET_ADMIN，设置失败时退回普通的中断收包
+void zv_set_busy_poll(zv_reactor *reactor, int fd) {
+    int usec = reactor->conf->busy_poll;
+    if(usec <= 0) {
+        return;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+    setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &opt, sizeof(opt));
+}
+
+//关闭客户端连接：从epoll中移除、关闭fd并重置连接结构体
+void zv_close_connect(zv_reactor *reactor, zv_connect *conn) {
+    int fd = conn->fd;
+    //清除对应连接结构体
+    conn->fd = -1;
+    zv_buffer_put(reactor, &conn->rbuffer);
+    zv_buffer_put(reactor, &conn->wbuffer.buf);
+    kv_out_reset(&conn->wbuffer);
+    conn->rchecked = 0;
+    conn->proto = KV_PROTO_NONE;
+    conn->mc_swallow = 0;
+    //连接关闭后不会再收到完成通知，内核持有的是页面本身，释放value不影响仍在发送的数据
+    for(int i = 0; i < conn->npin; i++) {
+        kv_value_unref(conn->pins[i].value);
     }
-    zv_connblock_index *blk = reactor->blockheader;
-    int index = 0;
-    while(++index < blk_idx) {//注意index先自增后比较
-        blk = blk->next;
+    free(conn->pins);
+    conn->pins = NULL;
+    conn->npin = 0;
+    conn->pin_size = 0;
+    conn->zerocopy = 0;
+    conn->zc_seq = 0;
+    zv_timer_del(&reactor->timers, &conn->idle_timer);
+    conn->pending = 0;
+    //从epoll监听事件中移除
+    epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, fd, NULL);
+    //关闭连接
+    close(fd);
+    if(reactor->conf->verbose) {
+        printf("close connection : clientfd : %d\n", fd);
+    }
+}
+
+//fd耗尽（EMFILE/ENFILE）时连接会一直留在全连接队列中，水平触发的监听套接字使epoll_wait立即再次返回，reactor空转
+//关闭预留的fd腾出一个位置，接受并立即关闭排队的连接直到队列取空，再重新预留，返回关闭的连接数
+//客户端立即收到连接关闭，而不是在队列中等待超时
+int zv_accept_overflow(zv_reactor *reactor, int listenfd) {
+    if(reactor->spare_fd < 0) {
+        return 0;
+    }
+    int dropped = 0;
+    while(1) {
+        close(reactor->spare_fd);
+        int clientfd = accept(listenfd, NULL, NULL);
+        if(clientfd >= 0) {
+            close(clientfd);
+            dropped++;
+        }
+        reactor->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if(clientfd < 0 || reactor->spare_fd < 0) {
+            break;
+        }
+    }
+    if(dropped > 0) {
+        fprintf(stderr, "reactor %d : too many open files, %d connections dropped\n", reactor->id, dropped);
+    }
+    return dropped;
+}
+
+//每次调度连接前重置预算，一个连接的深度流水线不能独占整轮事件处理
+void zv_set_quota(zv_reactor *reactor, zv_connect *conn) {
+    conn->quota = reactor->conf->fairness > 0 ? reactor->conf->fairness : -1;
+}
+
+//加入待处理队列，已在队列中时不重复加入
+int zv_schedule(zv_reactor *reactor, zv_connect *conn) {
+    if(conn->pending) {
+        return 0;
+    }
+    if(reactor->npending == reactor->pending_size) {
+        int size = reactor->pending_size ? reactor->pending_size * 2 : 64;
+        int *pending = (int *)realloc(reactor->pending, size * sizeof(int));
+        if(pending == NULL) {
+            perror("pending queue realloc fail\n");
+            return -1;
+        }
+        reactor->pending = pending;
+        reactor->pending_size = size;
+    }
+    reactor->pending[reactor->npending++] = conn->fd;
+    conn->pending = 1;
+    return 0;
+}
+
+//执行队列中已有的连接，执行中再次用完预算的连接排到队尾留给下一轮
+//队列中的连接可能已关闭或fd已被新连接复用，此时pending标记已被清除，直接跳过
+void zv_run_pending(zv_reactor *reactor) {
+    int count = reactor->npending;
+    //队列为空时pending可能还未分配，不能交给memmove
+    if(count == 0) {
+        return;
+    }
+    for(int i = 0; i < count; i++) {
+        int fd = reactor->pending[i];
+        zv_connect *conn = zv_connect_idx(reactor, fd);
+        if(conn->fd != fd || !conn->pending) {
+            continue;
+        }
+        conn->pending = 0;
+        //等待写事件的连接由send_cb继续
+        if(conn->cb == recv_cb) {
+            recv_cb(fd, EPOLLIN, reactor);
+        }
+    }
+    reactor->npending -= count;
+    memmove(reactor->pending, reactor->pending + count, reactor->npending * sizeof(int));
+}
+
+//开始空闲计时：收发数据时只更新last_active，不操作时间轮
+void zv_idle_start(zv_reactor *reactor, zv_connect *conn, zv_timer_cb cb) {
+    conn->last_active = reactor->now;
+    if(reactor->conf->idle_timeout == 0) {
+        return;
     }
-    return &(blk->block[(fd - 3) % connblock_size]);
+    conn->idle_timer.cb = cb;
+    conn->idle_timer.data = conn;
+    zv_timer_add(&reactor->timers, &conn->idle_timer, reactor->conf->idle_timeout);
+}
+
+//定时任务到期时连接若在此期间收发过数据，按剩余的时间重新计时，返回0；确实空闲返回1
+int zv_idle_expired(zv_reactor *reactor, zv_connect *conn) {
+    uint64_t idle = reactor->now - conn->last_active;
+    if(idle < reactor->conf->idle_timeout) {
+        zv_timer_add(&reactor->timers, &conn->idle_timer, reactor->conf->idle_timeout - idle);
+        return 0;
+    }
+    if(reactor->conf->verbose) {
+        printf("idle timeout : clientfd : %d\n", conn->fd);
+    }
+    return 1;
+}
+
+//epoll后端的空闲超时回调
+void zv_idle_cb(void *ctx, void *data) {
+    zv_reactor *reactor = (zv_reactor *)ctx;
+    zv_connect *conn = (zv_connect *)data;
+    if(zv_idle_expired(reactor, conn)) {
+        zv_close_connect(reactor, conn);
+    }
+}
+
+//按行切分接收缓冲区中的指令并依次执行，指令以\n结尾（\r\n亦可），返回执行的指令数量
+//不完整的指令保留在rbuffer中等待后续数据，所有回复追加到wbuffer后一次发送
+//wbuffer中待发送的回复达到limit时停止，剩下的指令在回复发出后继续执行，一个连接待发送的回复最多超出limit一条回复的长度
+//conn->quota用完时也停止，剩下的指令等下一次调度
+//rbuffer已满却仍没有一条完整的指令时扩容，返回-1表示指令超过max_command_len或内存不足
+int zv_process_input(zv_connect *conn, size_t limit) {
+    int count = 0;
+    size_t start = 0;//下一条指令在rbuffer中的起始位置
+    kv_buf *rbuf = &conn->rbuffer;
+    if(conn->proto == KV_PROTO_NONE && rbuf->len > 0) {
+        unsigned char first = (unsigned char)rbuf->data[0];
+        conn->proto = (first == '*') ? KV_PROTO_RESP : (first == KV_BIN_REQ) ? KV_PROTO_BIN : KV_PROTO_TEXT;
+    }
+    if(conn->proto != KV_PROTO_TEXT) {
+        return zv_process_sized(conn, limit);
+    }
+    while(start < rbuf->len && kv_out_len(&conn->wbuffer) < limit && conn->quota != 0) {
+        char *line = rbuf->data + start;
+        size_t checked = (start == 0) ? conn->rchecked : 0;
+        char *end = (char *)memchr(line + checked, '\n', rbuf->len - start - checked);
+        if(end == NULL) {//剩余的是不完整的指令
+            break;
+        }
+        start = end - rbuf->data + 1;
+        if(end > line && *(end - 1) == '\r') {
+            end--;
+        }
+        if(end == line) {//跳过空行
+            continue;
+        }
+        if(kv_protocol(line, end - line, &conn->wbuffer) != 0) {//指令按长度交给kv存储协议解析，不需要以'\0'结尾
+            return -1;
+        }
+        count++;
+        if(conn->quota > 0) {
+            conn->quota--;
+        }
+    }
+    //将未处理的数据前移到rbuffer开头
+    if(start > 0) {
+        rbuf->len -= start;
+        memmove(rbuf->data, rbuf->data + start, rbuf->len);
+    }
+    conn->rchecked = 0;
+    if(rbuf->len > 0 && memchr(rbuf->data, '\n', rbuf->len) == NULL) {
+        conn->rchecked = rbuf->len;
+        if(rbuf->len >= rbuf->size) {
+            if(rbuf->size >= max_command_len || kv_buf_reserve(rbuf, rbuf->size) != 0) {
+                return -1;
+            }
+        }
+    }
+    return count;
+}
+
+//按RESP数组、memcached指令或二进制协议头部切分接收缓冲区中的指令并依次执行，停止条件与文本协议相同
+//这些协议的参数或数据块都按长度定位，可以包含空格和换行；不完整的指令保留在rbuffer中，rbuffer已满时扩容
+int zv_process_sized(zv_connect *conn, size_t limit) {
+    int count = 0;
+    size_t start = 0;//下一条指令在rbuffer中的起始位置
+    kv_buf *rbuf = &conn->rbuffer;
+    kv_slice tokens[MAX_TOKENS];
+    int ret = 1;//最后一次解析的结果，0表示剩余的指令不完整
+    while(start < rbuf->len && kv_out_len(&conn->wbuffer) < limit && conn->quota != 0) {
+        //超过上限的数据块不进入rbuffer，到达多少丢弃多少
+        if(conn->mc_swallow > 0) {
+            size_t skip = (rbuf->len - start < conn->mc_swallow) ? rbuf->len - start : conn->mc_swallow;
+            start += skip;
+            conn->mc_swallow -= skip;
+            continue;
+        }
+        if(conn->proto == KV_PROTO_MC || conn->proto == KV_PROTO_BIN) {//解析和执行在一次调用中完成
+            char *data = rbuf->data + start;
+            size_t len = rbuf->len - start;
+            ret = (conn->proto == KV_PROTO_MC) ? kv_mc_protocol(data, len, &conn->wbuffer, &conn->mc_swallow) : kv_bin_protocol(data, len, &conn->wbuffer);
+            if(ret <= 0) {
+                break;
+            }
+            start += ret;
+        }
+        else {
+            int num_tokens = 0;
+            ret = kv_resp_parse(rbuf->data + start, rbuf->len - start, tokens, MAX_TOKENS, &num_tokens);
+            if(ret <= 0) {
+                break;
+            }
+            start += ret;
+            if(kv_execute(tokens, num_tokens, &conn->wbuffer, KV_PROTO_RESP) != 0) {
+                return -1;
+            }
+        }
+        count++;
+        if(conn->quota > 0) {
+            conn->quota--;
+        }
+    }
+    if(ret < 0) {//格式错误无法再确定后续指令的边界，或内存不足
+        return -1;
+    }
+    if(start > 0) {
+        rbuf->len -= start;
+        memmove(rbuf->data, rbuf->data + start, rbuf->len);
+    }
+    conn->rchecked = 0;
+    if(ret == 0 && rbuf->len >= rbuf->size) {
+        if(rbuf->size >= max_command_len || kv_buf_reserve(rbuf, rbuf->size) != 0) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+//发送wbuffer中的回复，一直发送到wbuffer为空或内核发送缓冲区满（EAGAIN），未发完的部分前移到wbuffer开头
+//缓冲区中的字节和引用的value组成iovec由sendmsg一次发出，较大的value不经过拷贝
+//开启MSG_ZEROCOPY时超过阈值的value单独发送，内核直接引用其内存，缓冲区中的字节仍然拷贝发送，之后可以立即复用
+//wbuffer发空后继续执行rbuffer中因wbuffer已满而暂停的指令并发送其回复
+//返回1表示回复已全部发出，0表示需要等待写事件，-1表示连接出错已关闭
+int zv_send_reply(zv_reactor *reactor, zv_connect *conn) {
+    kv_out *out = &conn->wbuffer;
+    size_t split = conn->zerocopy ? reactor->conf->zerocopy : 0;
+    struct iovec iov[send_iov_max];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    while(kv_out_len(out) > 0) {
+        while(kv_out_len(out) > 0) {
+            msg.msg_iovlen = kv_out_iov(out, iov, send_iov_max, split);
+            char *zc_value = kv_out_head_ref(out);
+            int flags = MSG_NOSIGNAL;
+            if(split > 0 && zc_value && kv_value_len(zc_value) >= split) {
+                flags |= MSG_ZEROCOPY;
+            }
+            ssize_t send_len = sendmsg(conn->fd, &msg, flags);
+            if(send_len >= 0) {
+                //内核在完成通知之前都会引用这次发送的value，先固定再释放wbuffer中的引用
+                if((flags & MSG_ZEROCOPY) && zv_zerocopy_pin(conn, zc_value) != 0) {
+                    zv_close_connect(reactor, conn);
+                    return -1;
+                }
+                //发送缓冲区中的数据随发送逐渐减少，发送完的value释放引用
+                kv_out_consume(out, send_len);
+            }
+            else if(errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {//超出optmem限制，本次退回普通发送
+                split = 0;
+                continue;
+            }
+            else if(errno == EINTR) {
+                continue;
+            }
+            else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            else {
+                perror("send fail\n");
+                zv_close_connect(reactor, conn);
+                return -1;
+            }
+        }
+        if(kv_out_len(out) > 0) {
+            return 0;
+        }
+        //还有暂停执行的指令，执行后继续发送
+        if(zv_process_input(conn, reactor->conf->output_limit) < 0) {
+            zv_close_connect(reactor, conn);
+            return -1;
+        }
+    }
+    return 1;
+}
+
+//固定一次MSG_ZEROCOPY发送中的value：增加引用计数并记录这次发送的序号
+int zv_zerocopy_pin(zv_connect *conn, char *value) {
+    if(conn->npin == conn->pin_size) {
+        int pin_size = conn->pin_size ? conn->pin_size * 2 : 8;
+        zv_zc_pin *pins = (zv_zc_pin *)realloc(conn->pins, pin_size * sizeof(zv_zc_pin));
+        if(pins == NULL) {
+            perror("zerocopy pins realloc fail\n");
+            return -1;
+        }
+        conn->pins = pins;
+        conn->pin_size = pin_size;
+    }
+    conn->pins[conn->npin].seq = conn->zc_seq++;
+    conn->pins[conn->npin].value = kv_value_ref(value);
+    conn->npin++;
+    return 0;
+}
+
+//读取错误队列中的完成通知，每条通知给出一段已完成的发送序号[lo, hi]，释放这些发送固定的value
+//返回读取到的通知数量
+int zv_zerocopy_reap(zv_connect *conn) {
+    int reaped = 0;
+    char control[128];
+    while(1) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if(recvmsg(conn->fd, &msg, MSG_ERRQUEUE) < 0) {//EAGAIN表示通知已读完
+            break;
+        }
+        for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if(!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+               !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            struct sock_extended_err *ee = (struct sock_extended_err *)CMSG_DATA(cm);
+            if(ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            //序号可能回绕，用差值比较
+            unsigned int lo = ee->ee_info;
+            unsigned int hi = ee->ee_data;
+            int kept = 0;
+            for(int i = 0; i < conn->npin; i++) {
+                unsigned int seq = conn->pins[i].seq;
+                if(seq - lo <= hi - lo) {
+                    kv_value_unref(conn->pins[i].value);
+                }
+                else {
+                    conn->pins[kept++] = conn->pins[i];
+                }
+            }
+            conn->npin = kept;
+            reaped++;
+        }
+    }
+    return reaped;
 }
 /*------------功能函数实现------------*/
 
@@ -225,137 +1016,797 @@ zv_connect *zv_connect_idx(zv_reactor *reactor, int fd) {
     event:事件类型
     arg:reactor，注意进行强制类型转换
  */
-//接收连接
+//接收连接：一次事件取出全连接队列中的所有连接，直到accept返回EAGAIN，连接风暴时队列能尽快清空
+//accept4直接得到非阻塞、close-on-exec的fd，不需要再为每个连接调用fcntl
 int accept_cb(int fd, int event, void *arg) {
-    //与客户端建立连接
-    struct sockaddr_in clientaddr;//请求连接的客户端地址信息
-    socklen_t len_sockaddr = sizeof(clientaddr);
-    int clientfd = accept(fd, (struct sockaddr *)&clientaddr, &len_sockaddr);
-    if(clientfd < 0) {
-        perror("accept new connect fail\n");
-        return -1;
-    }
-    //将连接存储到内存块
     zv_reactor *reactor = (zv_reactor *)arg;
-    //由于此连接刚产生，不存在与内存块中，因此返回的是一个空的连接结构体
-    //返回的连接结构体表示按照fd顺序存储连接，其应该存储在此返回的连接结构体中
-    zv_connect *conn = zv_connect_idx(reactor, clientfd);
-    conn->fd = clientfd;
-    conn->cb = recv_cb;//所有连接都是默认先由客户端发送数据到服务器
-    conn->next_len = max_buffer_len;
-    conn->rcount = 0;
-    conn->wcount = 0;
-    //将其加入epoll实例
-    struct epoll_event ev;
-    ev.data.fd = clientfd;
-    ev.events = EPOLLIN;
-    epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, clientfd, &ev);
-    printf("connect established, sockfd : %d, clientfd : %d\n", fd, clientfd);
+    (void)event;
+    while(1) {
+        //与客户端建立连接
+        struct sockaddr_storage clientaddr;//请求连接的客户端地址信息，TCP和AF_UNIX连接共用
+        socklen_t len_sockaddr = sizeof(clientaddr);
+        int clientfd = accept4(fd, (struct sockaddr *)&clientaddr, &len_sockaddr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(clientfd < 0) {
+            //队列已取空，或共享的AF_UNIX监听套接字上的连接已被其他reactor取走
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            //客户端在accept之前已断开，或被信号打断，继续取下一个连接
+            if(errno == ECONNABORTED || errno == EINTR) {
+                continue;
+            }
+            //fd耗尽时取空队列，避免监听套接字持续就绪
+            if(errno == EMFILE || errno == ENFILE) {
+                zv_accept_overflow(reactor, fd);
+                return -1;
+            }
+            perror("accept new connect fail\n");
+            return -1;
+        }
+        //由于此连接刚产生，不存在与内存块中，因此返回的是一个空的连接结构体
+        //返回的连接结构体表示按照fd顺序存储连接，其应该存储在此返回的连接结构体中
+        zv_connect *conn = zv_connect_idx(reactor, clientfd);
+        if(conn == NULL) {
+            close(clientfd);
+            continue;
+        }
+        if(clientaddr.ss_family == AF_INET) {
+            zv_set_nodelay(clientfd);
+            zv_set_busy_poll(reactor, clientfd);
+        }
+        //开启SO_ZEROCOPY后MSG_ZEROCOPY才生效，不支持的套接字（如AF_UNIX）退回普通发送
+        if(reactor->conf->zerocopy > 0) {
+            int opt = 1;
+            conn->zerocopy = (setsockopt(clientfd, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt)) == 0);
+        }
+        conn->fd = clientfd;
+        conn->proto = (fd == reactor->mc_fd) ? KV_PROTO_MC : KV_PROTO_NONE;
+        conn->cb = recv_cb;//所有连接都是默认先由客户端发送数据到服务器
+        conn->next_len = max_buffer_len;
+        conn->rchecked = 0;
+        conn->mc_swallow = 0;
+        conn->pending = 0;
+        zv_idle_start(reactor, conn, zv_idle_cb);
+        //将其加入epoll实例
+        struct epoll_event ev;
+        ev.data.fd = clientfd;
+        ev.events = EPOLLIN | zv_epoll_mode(reactor);
+        epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, clientfd, &ev);
+        if(reactor->conf->verbose) {
+            printf("reactor %d : connect established, sockfd : %d, clientfd : %d\n", reactor->id, fd, clientfd);
+        }
+    }
 }
 
 //接收数据
+//边沿触发模式下一次读到EAGAIN为止，水平触发模式下每次事件只读一次
+//指令执行后立即发送回复，不切换epoll事件；只有发送返回EAGAIN时才改为监听写事件
 int recv_cb(int fd, int event, void *arg) {
     zv_reactor *reactor = (zv_reactor *)arg;
+    (void)event;
     zv_connect *conn = zv_connect_idx(reactor, fd);
-    int recv_len = recv(fd, conn->rbuffer + conn->rcount, conn->next_len, 0);
-
-    if(recv_len < 0) {//发生错误
-        perror("recv error\n");
-        close(fd);
-        exit(0);
-    }
-    else if(recv_len == 0) {//对端已关闭连接
-        //清除对应连接结构体
-        conn->fd = -1;
-        conn->rcount = 0;
-        conn->wcount = 0;
-        //从epoll监听事件中移除
-        epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, fd, NULL);
-        //关闭连接
-        close(fd);
-        printf("close connection : clientfd : %d\n", fd);
+    int edge = reactor->conf->edge_triggered;
+    int drained = 0;//内核接收缓冲区是否已读空
+    kv_buf *rbuf = &conn->rbuffer;
+    conn->last_active = reactor->now;
+    zv_set_quota(reactor, conn);
+    //有数据到达时才为连接取得缓冲区
+    if(zv_buffer_get(reactor, rbuf) != 0 || zv_buffer_get(reactor, &conn->wbuffer.buf) != 0) {
+        zv_close_connect(reactor, conn);
+        return -1;
     }
-    else if(recv_len > 0) {//接收到有效数据
-        conn->rcount += recv_len;//更新读起始位置
-        conn->rcount = kv_protocol(conn->rbuffer, max_buffer_len);
-        //将kv存储的回复消息拷贝给wbuffer
-        memset(conn->wbuffer, '\0', max_buffer_len);
-        //拷贝接收缓冲区到当前接收起始位置的数据
-        memcpy(conn->wbuffer, conn->rbuffer, conn->rcount);
-        //更新发送缓冲区的当前写起始位置
-        conn->wcount = conn->rcount;
-        //清空接收缓冲区
-        memset(conn->rbuffer, 0, max_buffer_len);
-        //接收缓冲区写指针重置
-        conn->rcount = 0;
-
-        //事件切换，网络中读和写一般是交替发生
-        //将监听事件更改为epoll写事件
-        conn->cb = send_cb;
-        struct epoll_event ev;
-        ev.data.fd = fd;
-        ev.events = EPOLLOUT;
-        epoll_ctl(reactor->epfd, EPOLL_CTL_MOD, fd, &ev);
+    do {
+        while(rbuf->len < rbuf->size) {
+            ssize_t recv_len = recv(fd, rbuf->data + rbuf->len, rbuf->size - rbuf->len, 0);
+            if(recv_len > 0) {//接收到有效数据
+                rbuf->len += recv_len;//更新读起始位置
+                if(!edge) {
+                    break;
+                }
+            }
+            else if(recv_len == 0) {//对端已关闭连接
+                zv_close_connect(reactor, conn);
+                return 0;
+            }
+            else if(errno == EINTR) {
+                continue;
+            }
+            else if(errno == EAGAIN || errno == EWOULDBLOCK) {//内核接收缓冲区已读空
+                drained = 1;
+                break;
+            }
+            else {//发生错误
+                perror("recv error\n");
+                zv_close_connect(reactor, conn);
+                return -1;
+            }
+        }
+
+        //执行本次收到的所有完整指令，回复批量写入wbuffer
+        if(zv_process_input(conn, reactor->conf->output_limit) < 0) {
+            fprintf(stderr, "command too long, malformed or out of memory : clientfd : %d\n", fd);
+            zv_close_connect(reactor, conn);
+            return -1;
+        }
+        int ret = zv_send_reply(reactor, conn);
+        if(ret < 0) {
+            return -1;
+        }
+        if(ret == 0) {
+            //内核发送缓冲区已满，切换为写事件，回复发完之前不再读取新的指令
+            //边沿触发下切回读事件时的MOD会重新检查就绪状态，剩余未读的数据依旧会触发
+            conn->cb = send_cb;
+            struct epoll_event ev;
+            ev.data.fd = fd;
+            ev.events = EPOLLOUT | zv_epoll_mode(reactor);
+            epoll_ctl(reactor->epfd, EPOLL_CTL_MOD, fd, &ev);
+            return 0;
+        }
+        //边沿触发下若因rbuffer已满而停止读取，需要继续读，否则剩余数据不会再触发事件
+    } while(edge && !drained && conn->quota != 0);
+    //预算用完时rbuffer或内核中可能还有指令，边沿触发下不会再有事件，交给待处理队列在其他连接之后继续
+    if(conn->quota == 0) {
+        zv_schedule(reactor, conn);
     }
+    zv_release_idle_buffers(reactor, conn);
     return 0;
 }
 
-//发送数据，这里的实现只是简单的echo，将接收的数据直接回送
+//发送数据，只在上一次发送遇到EAGAIN后由写事件触发
+//回复全部发出后切换回读事件
 int send_cb(int fd, int event, void *arg) {
     zv_reactor *reactor = (zv_reactor *)arg;
+    (void)event;
     zv_connect *conn = zv_connect_idx(reactor, fd);
-    int send_len = send(fd, conn->wbuffer, conn->wcount, 0);
-    if(send_len < 0) {
-        perror("send fail\n");
-        close(fd);
-        return -1;
+    conn->last_active = reactor->now;
+    zv_set_quota(reactor, conn);
+    int ret = zv_send_reply(reactor, conn);
+    if(ret <= 0) {
+        return ret;//出错已关闭，或继续等待写事件
     }
-    memset(conn->wbuffer, 0, conn->next_len);
-    conn->wcount -= send_len;//发送缓冲区中的数据随发送逐渐减少
 
     //事件切换，将监听事件切换为epoll读事件
     conn->cb = recv_cb;
     struct epoll_event ev;
     ev.data.fd = fd;
-    ev.events = EPOLLIN;
+    ev.events = EPOLLIN | zv_epoll_mode(reactor);
     epoll_ctl(reactor->epfd, EPOLL_CTL_MOD, fd, &ev);
+    if(conn->quota == 0) {
+        zv_schedule(reactor, conn);
+    }
+    zv_release_idle_buffers(reactor, conn);
     return 0;
 }
 /*------------回调函数实现------------*/
 
 
-/*------------主程序运行相关------------*/
-//运行KV存储协议解析接收的数据并生成响应信息
-int kv_run_while(int argc, char *argv[]) {
-    //创建管理连接的reactor
-    zv_reactor *reactor = (zv_reactor *)malloc(sizeof(zv_reactor));
-    init_reactor(reactor);
-    //服务端初始化，输入的第一个参数是一个端口号
-    int start_port = atoi(argv[1]);
-    //可以同时监听多个端口，但当前设置为仅监听一个端口
-    for(int i = 0; i < listen_port_count; i++) {
-        int sockfd = init_server(start_port + i);
-        set_listener(reactor, sockfd, accept_cb);//将sockfd添加进epoll
+/*------------UDP查询------------*/
+/*
+    单个数据报的get/exist查询，请求和回复都以memcached的UDP帧头开头，客户端用请求id匹配回复
+    请求必须只有一个数据报；回复超过一个数据报时按序号拆分，每个数据报最长udp_packet_len
+    一次recvmmsg接收一批请求，全部执行后一次sendmmsg发出，发送缓冲区满时丢弃剩余的回复，由客户端超时重试
+*/
+//分配UDP收发状态，recvmmsg使用的msghdr只需设置一次
+int zv_udp_init(zv_reactor *reactor) {
+    zv_udp *udp = (zv_udp *)calloc(1, sizeof(zv_udp));
+    if(udp == NULL) {
+        perror("udp state calloc fail\n");
+        return -1;
+    }
+    for(int i = 0; i < udp_batch; i++) {
+        udp->riov[i].iov_base = udp->rbufs[i];
+        udp->riov[i].iov_len = udp_packet_len;
+        udp->rmsgs[i].msg_hdr.msg_iov = &udp->riov[i];
+        udp->rmsgs[i].msg_hdr.msg_iovlen = 1;
     }
-    //开始监听事件
-    printf("reactor and port init done, listening---\n");
+    reactor->udp = udp;
+    return 0;
+}
+
+//发送已生成的数据报，之后把reply中keep开始的数据（正在生成的回复）移到开头
+static void zv_udp_flush(zv_udp *udp, int fd, size_t keep) {
+    for(int i = 0; i < udp->ndgram; i++) {
+        zv_udp_dgram *dgram = &udp->dgrams[i];
+        udp->siov[i][0].iov_base = dgram->hdr;
+        udp->siov[i][0].iov_len = udp_header_len;
+        udp->siov[i][1].iov_base = udp->reply.data + dgram->off;
+        udp->siov[i][1].iov_len = dgram->len;
+        struct msghdr *msg = &udp->smsgs[i].msg_hdr;
+        msg->msg_name = &udp->addrs[dgram->req];
+        msg->msg_namelen = udp->rmsgs[dgram->req].msg_hdr.msg_namelen;
+        msg->msg_iov = udp->siov[i];
+        msg->msg_iovlen = 2;
+        msg->msg_control = NULL;
+        msg->msg_controllen = 0;
+        msg->msg_flags = 0;
+    }
+    int sent = 0;
+    while(sent < udp->ndgram) {
+        int ret = sendmmsg(fd, udp->smsgs + sent, udp->ndgram - sent, 0);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        sent += ret;
+    }
+    udp->ndgram = 0;
+    udp->reply.len -= keep;
+    memmove(udp->reply.data, udp->reply.data + keep, udp->reply.len);
+}
+
+//把out中的回复平铺追加到reply，引用的value也拷贝进来，UDP回复只发送一次不值得保留引用
+static int zv_udp_copy_reply(zv_udp *udp) {
+    struct iovec iov[send_iov_max];
+    while(kv_out_len(&udp->out) > 0) {
+        int cnt = kv_out_iov(&udp->out, iov, send_iov_max, 0);
+        size_t total = 0;
+        for(int i = 0; i < cnt; i++) {
+            if(kv_buf_reserve(&udp->reply, iov[i].iov_len) != 0) {
+                return -1;
+            }
+            memcpy(udp->reply.data + udp->reply.len, iov[i].iov_base, iov[i].iov_len);
+            udp->reply.len += iov[i].iov_len;
+            total += iov[i].iov_len;
+        }
+        kv_out_consume(&udp->out, total);
+    }
+    return 0;
+}
+
+//执行第req个请求，回复按udp_packet_len拆分为数据报
+//被截断、帧头不完整或由多个数据报组成的请求直接丢弃
+static void zv_udp_request(zv_udp *udp, int fd, int req) {
+    size_t len = udp->rmsgs[req].msg_len;
+    unsigned char *hdr = (unsigned char *)udp->rbufs[req];
+    if((udp->rmsgs[req].msg_hdr.msg_flags & MSG_TRUNC) || len <= udp_header_len || hdr[4] != 0 || hdr[5] != 1) {
+        return;
+    }
+    char *line = udp->rbufs[req] + udp_header_len;
+    size_t line_len = len - udp_header_len;
+    char *end = (char *)memchr(line, '\n', line_len);
+    if(end) {
+        line_len = end - line;
+    }
+    if(line_len > 0 && line[line_len - 1] == '\r') {
+        line_len--;
+    }
+
+    size_t start = udp->reply.len;
+    const char *error = NULL;
+    if(!kv_lookup_command(line, line_len)) {
+        error = "ERROR COMMAND\r\n";
+    }
+    else if(kv_protocol(line, line_len, &udp->out) != 0 || zv_udp_copy_reply(udp) != 0) {
+        kv_out_consume(&udp->out, kv_out_len(&udp->out));
+        udp->reply.len = start;
+        return;
+    }
+    size_t payload = udp_packet_len - udp_header_len;
+    if(!error && udp->reply.len - start > payload * udp_send_max) {
+        error = "VALUE TOO LARGE FOR UDP\r\n";
+    }
+    if(error) {
+        udp->reply.len = start;
+        size_t error_len = strlen(error);
+        if(kv_buf_reserve(&udp->reply, error_len) != 0) {
+            return;
+        }
+        memcpy(udp->reply.data + start, error, error_len);
+        udp->reply.len += error_len;
+    }
+    int total = (int)((udp->reply.len - start + payload - 1) / payload);
+    if(udp->ndgram + total > udp_send_max) {
+        zv_udp_flush(udp, fd, start);
+        start = 0;
+    }
+    for(int seq = 0; seq < total; seq++) {
+        zv_udp_dgram *dgram = &udp->dgrams[udp->ndgram++];
+        dgram->req = req;
+        dgram->off = start + (size_t)seq * payload;
+        dgram->len = (udp->reply.len - dgram->off < payload) ? udp->reply.len - dgram->off : payload;
+        dgram->hdr[0] = hdr[0];
+        dgram->hdr[1] = hdr[1];
+        dgram->hdr[2] = (unsigned char)(seq >> 8);
+        dgram->hdr[3] = (unsigned char)seq;
+        dgram->hdr[4] = (unsigned char)(total >> 8);
+        dgram->hdr[5] = (unsigned char)total;
+        dgram->hdr[6] = 0;
+        dgram->hdr[7] = 0;
+    }
+}
+
+//接收一批请求，逐个执行后一次发出所有回复
+int zv_udp_process(zv_reactor *reactor, int fd) {
+    zv_udp *udp = reactor->udp;
+    for(int i = 0; i < udp_batch; i++) {
+        udp->rmsgs[i].msg_hdr.msg_name = &udp->addrs[i];
+        udp->rmsgs[i].msg_hdr.msg_namelen = sizeof(udp->addrs[i]);
+    }
+    int count = recvmmsg(fd, udp->rmsgs, udp_batch, MSG_DONTWAIT, NULL);
+    if(count < 0) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        perror("udp recvmmsg fail\n");
+        return -1;
+    }
+    udp->reply.len = 0;
+    udp->ndgram = 0;
+    for(int i = 0; i < count; i++) {
+        zv_udp_request(udp, fd, i);
+    }
+    zv_udp_flush(udp, fd, udp->reply.len);
+    return count;
+}
+
+//UDP套接字可读，水平触发下每次事件处理一批，剩余的数据报会再次触发
+int udp_cb(int fd, int event, void *arg) {
+    zv_reactor *reactor = (zv_reactor *)arg;
+    (void)event;
+    return zv_udp_process(reactor, fd) < 0 ? -1 : 0;
+}
+/*------------UDP查询------------*/
+
+#if ENABLE_IO_URING
+/*------------io_uring后端------------*/
+/*
+    与epoll后端共用连接块、指令切分和kv存储协议，区别在于IO由内核异步完成：
+    监听套接字提交一次multishot accept，每个连接提交一次multishot recv并从provided buffer ring取缓冲区，
+    回复用send异步发送；一轮中产生的所有请求在下一次io_uring_submit_and_wait时由一次系统调用提交
+*/
+
+//完成事件类型，编码在user_data的高8位
+typedef enum zv_uring_op_e{
+    ZV_URING_ACCEPT = 0,
+    ZV_URING_RECV,
+    ZV_URING_SEND,
+    ZV_URING_CANCEL,
+    ZV_URING_POLL,//UDP套接字的multishot poll
+}zv_uring_op;
+
+//发送进行中的msghdr和iovec，提交后到完成前内核一直读取，因此随连接分配而不放在栈上
+typedef struct zv_uring_msg_s{
+    struct msghdr msg;
+    struct iovec iov[send_iov_max];
+}zv_uring_msg;
+
+//按完成事件类型分发的回调，取消请求的完成事件不需要处理
+static ZV_CALLBACK zv_uring_cbs[] = {uring_accept_cb, uring_recv_cb, uring_send_cb, NULL, uring_udp_cb};
+
+//user_data：高8位事件类型，中间24位连接代数，低32位fd
+static inline uint64_t zv_uring_data(int op, unsigned int gen, int fd) {
+    return ((uint64_t)op << 56) | ((uint64_t)(gen & 0xffffff) << 32) | (uint32_t)fd;
+}
+
+//获取一个提交队列项，提交队列满时先提交已有的请求
+static struct io_uring_sqe *zv_uring_sqe(zv_reactor *reactor) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&reactor->ring);
+    if(sqe == NULL) {
+        io_uring_submit(&reactor->ring);
+        sqe = io_uring_get_sqe(&reactor->ring);
+    }
+    return sqe;
+}
+
+//把编号为bid的缓冲区归还给buffer ring
+static void zv_uring_recycle(zv_reactor *reactor, int bid) {
+    io_uring_buf_ring_add(reactor->buf_ring, reactor->bufs + (size_t)bid * max_buffer_len, max_buffer_len,
+                          bid, io_uring_buf_ring_mask(uring_buf_count), 0);
+    io_uring_buf_ring_advance(reactor->buf_ring, 1);
+}
+
+//初始化本线程的io_uring和provided buffer ring
+int zv_uring_init(zv_reactor *reactor) {
+    int ret = io_uring_queue_init(uring_entries, &reactor->ring, 0);
+    if(ret < 0) {
+        fprintf(stderr, "io_uring_queue_init fail : %s\n", strerror(-ret));
+        return -1;
+    }
+    reactor->bufs = (char *)malloc((size_t)uring_buf_count * max_buffer_len);
+    if(reactor->bufs == NULL) {
+        perror("uring bufs malloc fail\n");
+        io_uring_queue_exit(&reactor->ring);
+        return -1;
+    }
+    reactor->buf_ring = io_uring_setup_buf_ring(&reactor->ring, uring_buf_count, uring_buf_group, 0, &ret);
+    if(reactor->buf_ring == NULL) {
+        fprintf(stderr, "io_uring_setup_buf_ring fail : %s\n", strerror(-ret));
+        free(reactor->bufs);
+        io_uring_queue_exit(&reactor->ring);
+        return -1;
+    }
+    for(int i = 0; i < uring_buf_count; i++) {
+        io_uring_buf_ring_add(reactor->buf_ring, reactor->bufs + (size_t)i * max_buffer_len, max_buffer_len,
+                              i, io_uring_buf_ring_mask(uring_buf_count), i);
+    }
+    io_uring_buf_ring_advance(reactor->buf_ring, uring_buf_count);
+    return 0;
+}
+
+//销毁本线程的io_uring
+void zv_uring_exit(zv_reactor *reactor) {
+    io_uring_free_buf_ring(&reactor->ring, reactor->buf_ring, uring_buf_count, uring_buf_group);
+    io_uring_queue_exit(&reactor->ring);
+    free(reactor->bufs);
+    reactor->bufs = NULL;
+}
+
+//为监听套接字提交multishot accept，一次提交持续产生新连接的完成事件
+int zv_uring_set_listener(zv_reactor *reactor, int listenfd) {
+    if(listenfd < 0) {
+        return -1;
+    }
+    zv_connect *conn = zv_connect_idx(reactor, listenfd);
+    if(conn == NULL) {
+        return -1;
+    }
+    conn->fd = listenfd;
+    conn->cb = uring_accept_cb;
+    struct io_uring_sqe *sqe = zv_uring_sqe(reactor);
+    io_uring_prep_multishot_accept(sqe, listenfd, NULL, NULL, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(sqe, zv_uring_data(ZV_URING_ACCEPT, 0, listenfd));
+    return 0;
+}
+
+//为连接提交multishot recv，数据写入内核从buffer ring中选取的缓冲区
+static void zv_uring_arm_recv(zv_reactor *reactor, zv_connect *conn) {
+    struct io_uring_sqe *sqe = zv_uring_sqe(reactor);
+    io_uring_prep_recv_multishot(sqe, conn->fd, NULL, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = uring_buf_group;
+    io_uring_sqe_set_data64(sqe, zv_uring_data(ZV_URING_RECV, conn->gen, conn->fd));
+    conn->recv_armed = 1;
+    conn->recv_cancel = 0;
+}
+
+//没有正在进行的发送时，把wbuffer中的回复提交发送，引用的value与epoll后端一样通过iovec直接发送
+static void zv_uring_send(zv_reactor *reactor, zv_connect *conn) {
+    if(conn->wsending > 0 || kv_out_len(&conn->wbuffer) == 0) {
+        return;
+    }
+    if(conn->wmsg == NULL) {
+        conn->wmsg = (zv_uring_msg *)calloc(1, sizeof(zv_uring_msg));
+        if(conn->wmsg == NULL) {
+            perror("uring msghdr calloc fail\n");
+            return;
+        }
+        conn->wmsg->msg.msg_iov = conn->wmsg->iov;
+    }
+    zv_uring_msg *wmsg = conn->wmsg;
+    wmsg->msg.msg_iovlen = kv_out_iov(&conn->wbuffer, wmsg->iov, send_iov_max, 0);
+    conn->wsending = 0;
+    for(size_t i = 0; i < wmsg->msg.msg_iovlen; i++) {
+        conn->wsending += wmsg->iov[i].iov_len;
+    }
+    struct io_uring_sqe *sqe = zv_uring_sqe(reactor);
+    io_uring_prep_sendmsg(sqe, conn->fd, &wmsg->msg, MSG_NOSIGNAL);
+    io_uring_sqe_set_data64(sqe, zv_uring_data(ZV_URING_SEND, conn->gen, conn->fd));
+}
+
+//关闭连接，shutdown使仍在内核中的multishot recv和发送结束，代数加1使之后到达的完成事件被丢弃
+//发送进行中时内核仍在读取wmsg、wbuffer和其中引用的value，先只shutdown，等发送的完成事件到达后再释放并关闭fd
+//在此之前fd没有关闭，不会被新连接复用，连接结构体保持不变
+static void zv_uring_close(zv_reactor *reactor, zv_connect *conn) {
+    if(conn->closing) {
+        return;
+    }
+    shutdown(conn->fd, SHUT_RDWR);
+    free(conn->backlog);
+    conn->backlog = NULL;
+    conn->backlog_len = 0;
+    conn->recv_armed = 0;
+    if(conn->wsending > 0) {
+        conn->closing = 1;
+        zv_timer_del(&reactor->timers, &conn->idle_timer);
+        return;
+    }
+    conn->gen++;
+    zv_close_connect(reactor, conn);
+}
+
+//fd耗尽后重新提交监听套接字的multishot accept
+static void zv_uring_accept_retry(void *ctx, void *data) {
+    zv_reactor *reactor = (zv_reactor *)ctx;
+    zv_connect *listener = (zv_connect *)data;
+    zv_uring_set_listener(reactor, listener->fd);
+}
+
+//io_uring后端的空闲超时回调
+static void zv_uring_idle_cb(void *ctx, void *data) {
+    zv_reactor *reactor = (zv_reactor *)ctx;
+    zv_connect *conn = (zv_connect *)data;
+    if(zv_idle_expired(reactor, conn)) {
+        zv_uring_close(reactor, conn);
+    }
+}
+
+//执行已接收的指令并发送回复：rbuffer腾出空间后从backlog补充数据，直到没有可执行的指令
+//发送进行中时内核正在读取wbuffer，wbuffer不能扩容移动，指令等发送完成后再执行
+//backlog过多时取消multishot recv，backlog清空后重新提交
+static int zv_uring_process(zv_reactor *reactor, zv_connect *conn) {
+    kv_buf *rbuf = &conn->rbuffer;
+    while(conn->wsending == 0) {
+        if(zv_process_input(conn, reactor->conf->output_limit) < 0) {
+            fprintf(stderr, "command too long, malformed or out of memory : clientfd : %d\n", conn->fd);
+            zv_uring_close(reactor, conn);
+            return -1;
+        }
+        size_t space = rbuf->size - rbuf->len;
+        size_t move = conn->backlog_len < space ? conn->backlog_len : space;
+        if(move == 0) {
+            break;
+        }
+        memcpy(rbuf->data + rbuf->len, conn->backlog, move);
+        rbuf->len += move;
+        conn->backlog_len -= move;
+        memmove(conn->backlog, conn->backlog + move, conn->backlog_len);
+    }
+    zv_uring_send(reactor, conn);
+
+    if(conn->backlog_len > uring_backlog_limit && conn->recv_armed && !conn->recv_cancel) {
+        struct io_uring_sqe *sqe = zv_uring_sqe(reactor);
+        io_uring_prep_cancel64(sqe, zv_uring_data(ZV_URING_RECV, conn->gen, conn->fd), 0);
+        io_uring_sqe_set_data64(sqe, zv_uring_data(ZV_URING_CANCEL, conn->gen, conn->fd));
+        conn->recv_cancel = 1;
+    }
+    else if(conn->backlog_len == 0 && !conn->recv_armed) {
+        zv_uring_arm_recv(reactor, conn);
+    }
+    //连接空闲时归还读写缓冲区和backlog
+    if(conn->wsending == 0 && conn->backlog_len == 0) {
+        free(conn->backlog);
+        conn->backlog = NULL;
+        free(conn->wmsg);
+        conn->wmsg = NULL;
+        zv_release_idle_buffers(reactor, conn);
+    }
+    return 0;
+}
+
+//接收连接：res为新连接的fd
+int uring_accept_cb(int fd, int res, void *arg) {
+    zv_reactor *reactor = (zv_reactor *)arg;
+    //fd耗尽时内核的accept先分配fd，队列为空也会立即失败，马上重新提交只会不断失败
+    //取空队列后由监听套接字连接结构体中的定时任务稍后重新提交
+    if(res == -EMFILE || res == -ENFILE) {
+        zv_accept_overflow(reactor, fd);
+        if(!(reactor->cqe_flags & IORING_CQE_F_MORE)) {
+            zv_connect *listener = zv_connect_idx(reactor, fd);
+            listener->idle_timer.cb = zv_uring_accept_retry;
+            listener->idle_timer.data = listener;
+            zv_timer_add(&reactor->timers, &listener->idle_timer, uring_accept_retry_ms);
+        }
+        return -1;
+    }
+    //multishot accept因出错结束后需要重新提交
+    if(!(reactor->cqe_flags & IORING_CQE_F_MORE)) {
+        zv_uring_set_listener(reactor, fd);
+    }
+    if(res < 0) {
+        fprintf(stderr, "uring accept fail : %s\n", strerror(-res));
+        return -1;
+    }
+    zv_connect *conn = zv_connect_idx(reactor, res);
+    if(conn == NULL) {
+        close(res);
+        return -1;
+    }
+    //AF_UNIX连接不支持TCP_NODELAY，设置失败不影响连接
+    zv_set_nodelay(res);
+    zv_set_busy_poll(reactor, res);
+    conn->fd = res;
+    conn->proto = (fd == reactor->mc_fd) ? KV_PROTO_MC : KV_PROTO_NONE;
+    conn->cb = uring_recv_cb;
+    conn->quota = -1;//每次完成事件最多执行到wbuffer达到上限，已经受output_limit约束
+    conn->next_len = max_buffer_len;
+    conn->rchecked = 0;
+    conn->mc_swallow = 0;
+    conn->wsending = 0;
+    conn->backlog = NULL;
+    conn->backlog_len = 0;
+    conn->closing = 0;
+    conn->gen++;
+    zv_idle_start(reactor, conn, zv_uring_idle_cb);
+    zv_uring_arm_recv(reactor, conn);
+    if(reactor->conf->verbose) {
+        printf("reactor %d : uring connect established, sockfd : %d, clientfd : %d\n", reactor->id, fd, res);
+    }
+    return 0;
+}
+
+//接收数据：res为本次接收的字节数，数据位于内核选取的缓冲区中
+//数据拷贝进rbuffer（放不下的部分进入backlog）后立即归还缓冲区
+int uring_recv_cb(int fd, int res, void *arg) {
+    zv_reactor *reactor = (zv_reactor *)arg;
+    zv_connect *conn = zv_connect_idx(reactor, fd);
+    if(!(reactor->cqe_flags & IORING_CQE_F_MORE)) {
+        conn->recv_armed = 0;
+    }
+    conn->last_active = reactor->now;
+    if(res > 0) {
+        int bid = reactor->cqe_flags >> IORING_CQE_BUFFER_SHIFT;
+        char *data = reactor->bufs + (size_t)bid * max_buffer_len;
+        kv_buf *rbuf = &conn->rbuffer;
+        //有数据到达时才为连接取得缓冲区
+        if(zv_buffer_get(reactor, rbuf) != 0 || zv_buffer_get(reactor, &conn->wbuffer.buf) != 0) {
+            zv_uring_recycle(reactor, bid);
+            zv_uring_close(reactor, conn);
+            return -1;
+        }
+        size_t space = rbuf->size - rbuf->len;
+        size_t copy = (conn->backlog_len == 0 && (size_t)res <= space) ? (size_t)res : 0;
+        memcpy(rbuf->data + rbuf->len, data, copy);
+        rbuf->len += copy;
+        if(copy < (size_t)res) {
+            char *backlog = (char *)realloc(conn->backlog, conn->backlog_len + res);
+            if(backlog == NULL) {
+                perror("uring backlog realloc fail\n");
+                zv_uring_recycle(reactor, bid);
+                zv_uring_close(reactor, conn);
+                return -1;
+            }
+            memcpy(backlog + conn->backlog_len, data, res);
+            conn->backlog = backlog;
+            conn->backlog_len += res;
+        }
+        zv_uring_recycle(reactor, bid);
+    }
+    else if(res == 0 || (res != -ENOBUFS && res != -ECANCELED)) {//对端关闭连接或出错
+        zv_uring_close(reactor, conn);
+        return 0;
+    }
+    return zv_uring_process(reactor, conn);
+}
+
+//发送数据：res为已发送的字节数，未发送的部分前移后继续发送，并恢复因wbuffer已满而暂停的指令
+//连接在发送期间已请求关闭时，内核不再读取发送的数据，此时才真正关闭
+int uring_send_cb(int fd, int res, void *arg) {
+    zv_reactor *reactor = (zv_reactor *)arg;
+    zv_connect *conn = zv_connect_idx(reactor, fd);
+    conn->wsending = 0;
+    if(conn->closing) {
+        conn->closing = 0;
+        zv_uring_close(reactor, conn);
+        return -1;
+    }
+    if(res < 0) {
+        if(res != -EPIPE && res != -ECONNRESET) {
+            fprintf(stderr, "uring send fail : %s\n", strerror(-res));
+        }
+        zv_uring_close(reactor, conn);
+        return -1;
+    }
+    conn->last_active = reactor->now;
+    kv_out_consume(&conn->wbuffer, res);
+    return zv_uring_process(reactor, conn);
+}
+
+//为UDP套接字提交multishot poll，可读时在完成事件中用recvmmsg批量接收
+int zv_uring_set_udp(zv_reactor *reactor, int udpfd) {
+    zv_connect *conn = zv_connect_idx(reactor, udpfd);
+    if(conn == NULL) {
+        return -1;
+    }
+    conn->fd = udpfd;
+    conn->cb = uring_udp_cb;
+    struct io_uring_sqe *sqe = zv_uring_sqe(reactor);
+    io_uring_prep_poll_multishot(sqe, udpfd, POLLIN);
+    io_uring_sqe_set_data64(sqe, zv_uring_data(ZV_URING_POLL, conn->gen, udpfd));
+    return 0;
+}
+
+//UDP套接字可读：multishot poll只在新数据报到达时通知，因此一直接收到EAGAIN为止
+int uring_udp_cb(int fd, int res, void *arg) {
+    zv_reactor *reactor = (zv_reactor *)arg;
+    if(!(reactor->cqe_flags & IORING_CQE_F_MORE)) {
+        zv_uring_set_udp(reactor, fd);
+    }
+    if(res < 0) {
+        fprintf(stderr, "uring udp poll fail : %s\n", strerror(-res));
+        return -1;
+    }
+    while(zv_udp_process(reactor, fd) == udp_batch);
+    return 0;
+}
+
+//io_uring后端的事件循环：提交本轮产生的所有请求并等待至少一个完成事件，再批量分发完成事件
+//有定时任务时等待不超过时间轮给出的超时，分发完成事件后执行到期的定时任务
+int zv_uring_loop(zv_reactor *reactor) {
+    reactor->now = zv_timer_now();
+    while(1) {
+        struct io_uring_cqe *cqe;
+        int ret;
+        int timeout = zv_timer_timeout(&reactor->timers, reactor->now);
+        if(timeout >= 0) {
+            struct __kernel_timespec ts;
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+            ret = io_uring_submit_and_wait_timeout(&reactor->ring, &cqe, 1, &ts, NULL);
+        }
+        else {
+            ret = io_uring_submit_and_wait(&reactor->ring, 1);
+        }
+        reactor->now = zv_timer_now();
+        if(ret < 0 && ret != -EINTR && ret != -ETIME) {
+            fprintf(stderr, "io_uring_submit_and_wait fail : %s\n", strerror(-ret));
+            break;
+        }
+        unsigned int head;
+        unsigned int count = 0;
+        io_uring_for_each_cqe(&reactor->ring, head, cqe) {
+            count++;
+            uint64_t data = io_uring_cqe_get_data64(cqe);
+            int op = (int)(data >> 56);
+            unsigned int gen = (unsigned int)(data >> 32) & 0xffffff;
+            int fd = (int)(uint32_t)data;
+            if(op == ZV_URING_CANCEL) {
+                continue;
+            }
+            zv_connect *conn = zv_connect_idx(reactor, fd);
+            //连接已关闭或fd已被新连接复用，丢弃完成事件，占用的缓冲区仍需归还
+            //等待发送完成后关闭的连接只处理发送的完成事件
+            if(op != ZV_URING_ACCEPT && (conn->fd != fd || (conn->gen & 0xffffff) != gen || (conn->closing && op != ZV_URING_SEND))) {
+                if(cqe->flags & IORING_CQE_F_BUFFER) {
+                    zv_uring_recycle(reactor, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                }
+                continue;
+            }
+            reactor->cqe_flags = cqe->flags;
+            zv_uring_cbs[op](fd, cqe->res, reactor);
+        }
+        io_uring_cq_advance(&reactor->ring, count);
+        //执行到期的定时任务
+        zv_timer_expire(&reactor->timers, reactor->now, reactor);
+    }
+    return 0;
+}
+/*------------io_uring后端------------*/
+#endif
+
+/*------------主程序运行相关------------*/
+//reactor线程的事件循环：等待并分发本线程epoll上的就绪事件，再执行到期的定时任务
+int zv_reactor_loop(zv_reactor *reactor) {
     //就绪事件集合，epoll_wait会将就绪事件按序写入此集合
     struct epoll_event events[epoll_events_size] = {0};
+    reactor->now = zv_timer_now();
     while(1) {
-        //等待事件发生
-        int nready = epoll_wait(reactor->epfd, events, epoll_events_size, -1);
+        //等待事件发生，有定时任务时最多等到时间轮下一次需要处理的时刻，有待处理连接时不等待
+        int timeout = reactor->npending > 0 ? 0 : zv_timer_timeout(&reactor->timers, reactor->now);
+        int nready = 0;
+        //忙轮询：阻塞之前先用不等待的epoll_wait空转至多busy_poll微秒，事件到达时省去线程唤醒的延迟
+        if(reactor->conf->busy_poll > 0 && timeout != 0) {
+            uint64_t deadline = zv_timer_now_us() + reactor->conf->busy_poll;
+            do {
+                nready = epoll_wait(reactor->epfd, events, epoll_events_size, 0);
+            } while(nready == 0 && zv_timer_now_us() < deadline);
+        }
+        if(nready == 0) {
+            nready = epoll_wait(reactor->epfd, events, epoll_events_size, timeout);
+        }
+        reactor->now = zv_timer_now();
         if(nready == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
             perror("epoll_wait fail\n");
             break;
         }
-        else if(nready == 0) {
-            continue;
-        }
         else if(nready > 0) {
             //处理所有就绪事件，epoll_wait函数捕获的就绪事件会在events数组中按序存储，遍历前nready个元素即可
             for(int i = 0;i < nready; i++) {
                 int connfd = events[i].data.fd;
                 zv_connect *conn = zv_connect_idx(reactor, connfd);
+                //错误队列中有MSG_ZEROCOPY完成通知时也会报告EPOLLERR
+                //没有通知则是套接字出错，交给回调在读写时处理并关闭连接
+                if((EPOLLERR & events[i].events) && conn->zerocopy && zv_zerocopy_reap(conn) > 0) {
+                    events[i].events &= ~EPOLLERR;
+                }
+                if((EPOLLERR & events[i].events) && !((EPOLLIN | EPOLLOUT) & events[i].events)) {
+                    conn->cb(connfd, events[i].events, reactor);
+                    continue;
+                }
                 //事件处理
                 //下面两个回调中events[i].events参数未被使用
                 if(EPOLLIN & events[i].events) {
@@ -366,22 +1817,286 @@ int kv_run_while(int argc, char *argv[]) {
                 }
             }
         }
+        //就绪连接各执行一次后，再继续上一轮预算用完的连接
+        zv_run_pending(reactor);
+        //执行到期的定时任务
+        zv_timer_expire(&reactor->timers, reactor->now, reactor);
+    }
+    return 0;
+}
+
+//按所选后端注册监听套接字
+static void zv_register_listener(zv_reactor *reactor, int listenfd) {
+#if ENABLE_IO_URING
+    if(reactor->conf->backend == ZV_BACKEND_URING) {
+        zv_uring_set_listener(reactor, listenfd);
+        return;
+    }
+#endif
+    set_listener(reactor, listenfd, accept_cb);//将listenfd添加进本线程的epoll
+}
+
+//在本线程的reactor上创建SO_REUSEPORT监听套接字，然后进入所选后端的事件循环
+static void zv_reactor_run(zv_reactor *reactor) {
+#if ENABLE_IO_URING
+    int uring = (reactor->conf->backend == ZV_BACKEND_URING);
+    if(uring && zv_uring_init(reactor) != 0) {
+        return;
+    }
+#endif
+    //可以同时监听多个端口，但当前设置为仅监听一个端口
+    for(int i = 0; i < listen_port_count; i++) {
+        int sockfd = init_server(reactor->conf->port + i, reactor->conf->backlog);
+        if(sockfd < 0) {
+            return;
+        }
+        zv_register_listener(reactor, sockfd);
+    }
+    //memcached端口与主端口一样每个reactor一个SO_REUSEPORT监听套接字，使用同样的回调，连接的协议在accept时确定
+    if(reactor->conf->mc_port > 0) {
+        reactor->mc_fd = init_server(reactor->conf->mc_port, reactor->conf->backlog);
+        if(reactor->mc_fd < 0) {
+            return;
+        }
+        zv_register_listener(reactor, reactor->mc_fd);
+    }
+    //AF_UNIX监听套接字与TCP监听套接字使用同样的回调
+    if(reactor->conf->unix_fd >= 0) {
+        zv_register_listener(reactor, reactor->conf->unix_fd);
+    }
+    if(reactor->conf->udp_port > 0) {
+        int udpfd = init_udp_server(reactor->conf->udp_port);
+        if(udpfd < 0 || zv_udp_init(reactor) != 0) {
+            return;
+        }
+#if ENABLE_IO_URING
+        if(uring) {
+            zv_uring_set_udp(reactor, udpfd);
+        }
+        else {
+            set_listener(reactor, udpfd, udp_cb);
+        }
+#else
+        set_listener(reactor, udpfd, udp_cb);
+#endif
+    }
+    printf("reactor %d init done, listening---\n", reactor->id);
+#if ENABLE_IO_URING
+    if(uring) {
+        zv_uring_loop(reactor);
+        zv_uring_exit(reactor);
+        return;
+    }
+#endif
+    zv_reactor_loop(reactor);
+}
+
+//reactor线程入口：reactor在本线程中分配和初始化
+//线程创建时已绑定CPU，reactor、连接块、缓冲池和io_uring的内存由本线程首次写入，按首次访问策略来自本地NUMA节点
+void *zv_reactor_thread(void *arg) {
+    zv_thread_arg *targ = (zv_thread_arg *)arg;
+    zv_reactor *reactor = (zv_reactor *)malloc(sizeof(zv_reactor));
+    if(reactor == NULL) {
+        perror("reactor malloc fail\n");
+        return NULL;
+    }
+    if(init_reactor(reactor, targ->id, targ->conf) == 0) {
+        zv_reactor_run(reactor);
     }
     destroy_reactor(reactor);
+    free(reactor);
+    return NULL;
+}
+
+//解析CPU列表，格式与taskset -c相同，如"0-3,8,10-11"
+int zv_parse_cpus(zv_config *conf, const char *list) {
+    const char *p = list;
+    conf->cpu_count = 0;
+    while(*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if(end == p || first < 0 || first >= CPU_SETSIZE) {
+            return -1;
+        }
+        long last = first;
+        if(*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if(end == p || last < first || last >= CPU_SETSIZE) {
+                return -1;
+            }
+        }
+        for(long cpu = first; cpu <= last; cpu++) {
+            if(conf->cpu_count == CPU_SETSIZE) {
+                return -1;
+            }
+            conf->cpus[conf->cpu_count++] = (int)cpu;
+        }
+        if(*end == ',') {
+            end++;
+        }
+        else if(*end != '\0') {
+            return -1;
+        }
+        p = end;
+    }
+    return conf->cpu_count > 0 ? 0 : -1;
+}
+
+//解析命令行参数：./kvstore [-t reactor线程数] [-e] [-b epoll|uring] [-z zerocopy阈值] [-u unix套接字路径] [-i 空闲超时秒数] [-l listen队列长度] [-o 单连接回复上限] [-P 忙轮询微秒数] [-c 绑定的CPU列表] [-f 每轮指令预算] [-U UDP查询端口] [-M memcached端口] [-v] port
+int zv_parse_args(zv_config *conf, int argc, char *argv[]) {
+    memset(conf, 0, sizeof(zv_config));
+    conf->reactor_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    conf->unix_fd = -1;
+    conf->backlog = listen_backlog;
+    conf->output_limit = max_wbuffer_len;
+    conf->fairness = fairness_budget;
+    int threads_set = 0;//是否用-t指定了线程数
+    int opt;
+    while((opt = getopt(argc, argv, "t:eb:z:u:i:l:o:P:c:f:U:M:v")) != -1) {
+        switch(opt) {
+            case 't':
+                conf->reactor_count = atoi(optarg);
+                threads_set = 1;
+                break;
+            case 'e':
+                conf->edge_triggered = 1;
+                break;
+            case 'b':
+                if(strcmp(optarg, "epoll") == 0) {
+                    conf->backend = ZV_BACKEND_EPOLL;
+                }
+                else if(strcmp(optarg, "uring") == 0 && ENABLE_IO_URING) {
+                    conf->backend = ZV_BACKEND_URING;
+                }
+                else {
+                    fprintf(stderr, "unsupported backend : %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'z':
+                conf->zerocopy = strtoul(optarg, NULL, 10);
+                break;
+            case 'u':
+                conf->unix_path = optarg;
+                break;
+            case 'i':
+                conf->idle_timeout = strtoull(optarg, NULL, 10) * 1000;
+                break;
+            case 'l':
+                conf->backlog = atoi(optarg);
+                break;
+            case 'o':
+                conf->output_limit = strtoul(optarg, NULL, 10);
+                break;
+            case 'P':
+                conf->busy_poll = atoi(optarg);
+                break;
+            case 'c':
+                if(zv_parse_cpus(conf, optarg) != 0) {
+                    fprintf(stderr, "invalid cpu list : %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'f':
+                conf->fairness = atoi(optarg);
+                break;
+            case 'U':
+                conf->udp_port = atoi(optarg);
+                break;
+            case 'M':
+                conf->mc_port = atoi(optarg);
+                break;
+            case 'v':
+                conf->verbose = 1;
+                break;
+            default:
+                return -1;
+        }
+    }
+    //剩下的唯一一个参数是端口号
+    if(optind != argc - 1) {
+        return -1;
+    }
+    conf->port = atoi(argv[optind]);
+    //只指定了CPU列表时每个CPU一个reactor
+    if(conf->cpu_count > 0 && !threads_set) {
+        conf->reactor_count = conf->cpu_count;
+    }
+    if(conf->port <= 0 || conf->reactor_count <= 0 || conf->backlog <= 0 || conf->output_limit == 0 || conf->busy_poll < 0 || conf->fairness < 0 || conf->udp_port < 0 || conf->mc_port < 0) {
+        return -1;
+    }
     return 0;
 }
 
+//运行KV存储协议解析接收的数据并生成响应信息
+//每个reactor线程一个epoll实例，存储引擎由所有线程共享，其并发控制在kvstore.c中完成
+int kv_run_while(const zv_config *conf) {
+    //reactor线程的启动参数，reactor本身在各自线程中创建
+    zv_thread_arg *targs = (zv_thread_arg *)calloc(conf->reactor_count, sizeof(zv_thread_arg));
+    if(targs == NULL) {
+        perror("reactor thread args calloc fail\n");
+        return -1;
+    }
+    int started = 0;
+    for(int i = 0; i < conf->reactor_count; i++) {
+        targs[i].id = i;
+        targs[i].conf = conf;
+        //绑核在创建线程时完成，线程从第一条指令起就运行在指定的CPU上
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if(conf->cpu_count > 0) {
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(conf->cpus[i % conf->cpu_count], &cpuset);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+        }
+        int ret = pthread_create(&targs[i].thread, &attr, zv_reactor_thread, &targs[i]);
+        pthread_attr_destroy(&attr);
+        if(ret != 0) {
+            fprintf(stderr, "create reactor thread fail : %s\n", strerror(ret));
+            break;
+        }
+        started++;
+    }
+    printf("%d reactor threads started\n", started);
+    for(int i = 0; i < started; i++) {
+        pthread_join(targs[i].thread, NULL);
+    }
+    free(targs);
+    return started == conf->reactor_count ? 0 : -1;
+}
+
 int main(int argc, char *argv[]) {
-    if(argc != 2) {
-        perror("request a port as input\n");
+    zv_config conf;
+    if(zv_parse_args(&conf, argc, argv) != 0) {
+        fprintf(stderr, "usage : %s [-t reactor_threads] [-e] [-b epoll|uring] [-z zerocopy_bytes] [-u unix_path] [-i idle_seconds] [-l backlog] [-o output_limit] [-P busy_poll_usec] [-c cpu_list] [-f fairness_budget] [-U udp_port] [-M memcached_port] [-v] port\n", argv[0]);
+        return -1;
+    }
+    //AF_UNIX监听套接字只创建一个，在reactor线程启动前交给所有reactor
+    if(conf.unix_path) {
+        conf.unix_fd = init_unix_server(conf.unix_path, conf.backlog);
+        if(conf.unix_fd < 0) {
+            return -1;
+        }
+    }
+    //初始化存储引擎，失败时不启动reactor
+    if(kv_engine_init() != 0) {
+        fprintf(stderr, "kv engine init fail\n");
+        if(conf.unix_fd >= 0) {
+            close(conf.unix_fd);
+            unlink(conf.unix_path);
+        }
         return -1;
     }
-    //初始化存储引擎
-    kv_engine_init();
     //运行KV存储
-    kv_run_while(argc, argv);
+    kv_run_while(&conf);
     //销毁存储引擎
     kv_engine_desy();
+    if(conf.unix_fd >= 0) {
+        close(conf.unix_fd);
+        unlink(conf.unix_path);
+    }
 
     return 0;
 }
@@ -6,6 +6,7 @@
 #include<string.h>
 
 #include<sys/socket.h>
+#include<sys/un.h>
 #include<netinet/in.h>
 #include<arpa/inet.h>
 #include<unistd.h>
@@ -65,6 +66,28 @@ int kv_connect(const char* ip, const int port){
     return connfd;
 }
 
+// 通过AF_UNIX套接字连接同一主机上的服务端，绕过TCP协议栈
+// 返回值：正整数表示连接的fd，-1错误
+int kv_connect_unix(const char* path){
+    struct sockaddr_un kv_addr;
+    memset(&kv_addr, 0, sizeof(kv_addr));
+    kv_addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(kv_addr.sun_path)){
+        printf("unix socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(kv_addr.sun_path, path);
+
+    int connfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int ret = connect(connfd, (struct sockaddr*)&kv_addr, sizeof(kv_addr));
+    if(ret != 0){
+        printf("connect error: %s\n", strerror(errno));
+        close(connfd);
+        return -1;
+    }
+    return connfd;
+}
+
 // 封装单个测试用例
 // 输入参数：
 // connfd：连接套接字
@@ -72,7 +95,10 @@ int kv_connect(const char* ip, const int port){
 // res：预期返回结果
 // 返回值：-1不匹配，0匹配
 int kv_test_case(const int connfd, const char* cmd, const char* res){
-    send(connfd, cmd, strlen(cmd), 0);
+    // 指令以\r\n结尾，服务端据此切分流水线中的指令
+    char s_cmd[max_buffer_len] = {0};
+    int cmd_len = snprintf(s_cmd, max_buffer_len, "%s\r\n", cmd);
+    send(connfd, s_cmd, cmd_len, 0);
 
     char rbuffer[max_buffer_len] = {0};
     recv(connfd, rbuffer, max_buffer_len, 0);
@@ -242,15 +268,21 @@ float test_cmd_qps(int connfd, int range, idx_engine i_engine, idx_cmd i_cmd){
 }
 
 // ./tb_kvstore ip port
+// ./tb_kvstore -u unix_path  服务端以-u启动时，使用AF_UNIX套接字测试，与TCP对比QPS
 int main(int argc, char* argv[]){
     // 解析命令行参数并连接
     if(argc != 3){
-        printf("error! argv format: ./tb_kvstore ip port\n");
+        printf("error! argv format: ./tb_kvstore ip port | ./tb_kvstore -u unix_path\n");
         return -1;
     }
-    const char* ip = argv[1];
-    const int port = atoi(argv[2]);
-    int connfd = kv_connect(ip, port);
+    int connfd = -1;
+    if(0 == strcmp(argv[1], "-u")){
+        connfd = kv_connect_unix(argv[2]);
+    }else{
+        const char* ip = argv[1];
+        const int port = atoi(argv[2]);
+        connfd = kv_connect(ip, port);
+    }
     if(connfd <= 0) return -1;
 
     // array测试
@@ -0,0 +1,74 @@
+#!/bin/bash
+# 冒烟测试：启动kv_server，对每个引擎前缀执行SET/GET/MSET/MGET/MDEL等指令，逐行比对文本协议的回复
+# 用法：test_smoke.sh [kv_server路径] [端口]
+SERVER=${1:-./kv_server}
+PORT=${2:-9527}
+
+"$SERVER" -t 1 "$PORT" >/dev/null 2>&1 &
+PID=$!
+trap 'kill $PID 2>/dev/null' EXIT
+
+# 等待服务端开始监听
+for i in $(seq 50); do
+    { exec 3<>/dev/tcp/127.0.0.1/$PORT; } 2>/dev/null && break
+    sleep 0.1
+done
+if ! { true >&3; } 2>/dev/null; then
+    echo "smoke: connect to 127.0.0.1:$PORT fail"
+    exit 1
+fi
+
+FAIL=0
+# 发送一条指令，按期望值的个数读取回复行并逐行比较
+check() {
+    local cmd=$1
+    shift
+    printf '%s\r\n' "$cmd" >&3
+    for want in "$@"; do
+        local got=""
+        read -t 2 -r got <&3
+        got=${got%$'\r'}
+        if [ "$got" != "$want" ]; then
+            echo "smoke: $cmd: expect '$want' got '$got'"
+            FAIL=1
+        fi
+    done
+}
+
+# 40对KV超过array单个块的容量，覆盖新块的创建与回收
+MSET_ARGS=""
+MDEL_ARGS=""
+for i in $(seq 40); do
+    MSET_ARGS="$MSET_ARGS m$i v$i"
+    MDEL_ARGS="$MDEL_ARGS m$i"
+done
+
+# 空前缀为array引擎
+for p in "" RB B SH DH SK; do
+    check "${p}SET k1 v1" OK
+    check "${p}SET k1 v1" "ALREADY HAVE THIS KEY"
+    check "${p}GET k1" v1
+    check "${p}MSET k2 v2 k3 v3" 2
+    check "${p}MGET k1 k2 k3 k4" v1 v2 v3 "NO KEY"
+    check "${p}MDEL k2 k3 k4" 2
+    check "${p}EXIST k2" FALSE
+    check "${p}COUNT" 1
+    check "${p}MSET$MSET_ARGS" 40
+    check "${p}GET m33" v33
+    check "${p}MDEL$MDEL_ARGS" 40
+    # 升序插入触发红黑树的RR/RL调整
+    check "${p}MSET a 1 p 2 q 3" 3
+    check "${p}MGET a p q" 1 2 3
+    check "${p}MDEL a p q" 3
+    check "${p}DELETE k1" OK
+    # 删除最后一个key后再查找
+    check "${p}EXIST k1" FALSE
+    check "${p}GET k1" "NO KEY"
+    check "${p}COUNT" 0
+done
+
+if [ $FAIL -ne 0 ]; then
+    echo "smoke: FAIL"
+    exit 1
+fi
+echo "smoke: OK"
@@ -0,0 +1,159 @@
+#include <time.h>
+#include "timer.h"
+
+/*------------链表操作------------*/
+//将timer插入到哨兵节点head之前，即链表末尾
+static void zv_timer_link(zv_timer *head, zv_timer *timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+//将timer从所在链表中摘下
+static void zv_timer_unlink(zv_timer *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+//初始化空链表
+static void zv_timer_list_init(zv_timer *head) {
+    head->prev = head;
+    head->next = head;
+}
+/*------------链表操作------------*/
+
+
+/*------------时间轮实现------------*/
+//当前的单调时间，使用粗粒度时钟，精度满足10毫秒的tick且开销更小
+uint64_t zv_timer_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//高精度的单调时间，通过vDSO读取，不进入内核
+uint64_t zv_timer_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//初始化时间轮
+void zv_timer_wheel_init(zv_timer_wheel *wheel, uint64_t now) {
+    for(int level = 0; level < ZV_TIMER_LEVELS; level++) {
+        for(int slot = 0; slot < ZV_TIMER_SLOTS; slot++) {
+            zv_timer_list_init(&wheel->slots[level][slot]);
+        }
+    }
+    wheel->start = now;
+    wheel->tick = 0;
+    wheel->count = 0;
+}
+
+//按到期tick与当前tick的差值选择层：差值小于64放第0层，小于64*64放第1层，以此类推
+//槽号取到期tick在该层对应的6位，该层转到这个槽时任务被降级到更低的层
+static void zv_timer_place(zv_timer_wheel *wheel, zv_timer *timer) {
+    uint64_t max = (1ULL << (ZV_TIMER_LEVELS * ZV_TIMER_SLOT_BITS)) - 1;
+    if(timer->expire - wheel->tick > max) {
+        timer->expire = wheel->tick + max;
+    }
+    uint64_t delta = timer->expire - wheel->tick;
+    int level = 0;
+    while(level < ZV_TIMER_LEVELS - 1 && delta >= (1ULL << ((level + 1) * ZV_TIMER_SLOT_BITS))) {
+        level++;
+    }
+    int slot = (timer->expire >> (level * ZV_TIMER_SLOT_BITS)) & ZV_TIMER_SLOT_MASK;
+    zv_timer_link(&wheel->slots[level][slot], timer);
+}
+
+//timeout毫秒后到期，至少在下一个tick到期
+void zv_timer_add(zv_timer_wheel *wheel, zv_timer *timer, uint64_t timeout) {
+    if(timer->next) {
+        zv_timer_unlink(timer);
+        wheel->count--;
+    }
+    uint64_t ticks = (timeout + ZV_TIMER_TICK_MS - 1) / ZV_TIMER_TICK_MS;
+    timer->expire = wheel->tick + (ticks ? ticks : 1);
+    zv_timer_place(wheel, timer);
+    wheel->count++;
+}
+
+//从时间轮中移除
+void zv_timer_del(zv_timer_wheel *wheel, zv_timer *timer) {
+    if(timer->next) {
+        zv_timer_unlink(timer);
+        wheel->count--;
+    }
+}
+
+//把高层的一个槽中的任务按剩余时间重新放入更低的层
+static void zv_timer_cascade(zv_timer_wheel *wheel, int level, int slot) {
+    zv_timer *head = &wheel->slots[level][slot];
+    while(head->next != head) {
+        zv_timer *timer = head->next;
+        zv_timer_unlink(timer);
+        zv_timer_place(wheel, timer);
+    }
+}
+
+//前进一个tick：第0层转完一圈时降级上一层当前槽的任务，再执行第0层当前槽中的任务
+//当前槽先整体移到临时链表，回调中删除或重新添加定时任务都不会影响遍历
+static void zv_timer_tick(zv_timer_wheel *wheel, void *ctx) {
+    wheel->tick++;
+    for(int level = 1; level < ZV_TIMER_LEVELS; level++) {
+        if(wheel->tick & ((1ULL << (level * ZV_TIMER_SLOT_BITS)) - 1)) {
+            break;
+        }
+        zv_timer_cascade(wheel, level, (wheel->tick >> (level * ZV_TIMER_SLOT_BITS)) & ZV_TIMER_SLOT_MASK);
+    }
+    zv_timer *head = &wheel->slots[0][wheel->tick & ZV_TIMER_SLOT_MASK];
+    if(head->next == head) {
+        return;
+    }
+    zv_timer expired;
+    zv_timer_list_init(&expired);
+    expired.next = head->next;
+    expired.prev = head->prev;
+    expired.next->prev = &expired;
+    expired.prev->next = &expired;
+    zv_timer_list_init(head);
+    while(expired.next != &expired) {
+        zv_timer *timer = expired.next;
+        zv_timer_unlink(timer);
+        wheel->count--;
+        timer->cb(ctx, timer->data);
+    }
+}
+
+//距离下一次需要处理时间轮的毫秒数：第0层中下一个非空槽的时刻，或第0层转完一圈需要降级高层任务的时刻
+int zv_timer_timeout(zv_timer_wheel *wheel, uint64_t now) {
+    if(wheel->count == 0) {
+        return -1;
+    }
+    uint64_t ticks = ZV_TIMER_SLOTS - (wheel->tick & ZV_TIMER_SLOT_MASK);
+    for(uint64_t i = 1; i < ticks; i++) {
+        zv_timer *head = &wheel->slots[0][(wheel->tick + i) & ZV_TIMER_SLOT_MASK];
+        if(head->next != head) {
+            ticks = i;
+            break;
+        }
+    }
+    uint64_t when = wheel->start + (wheel->tick + ticks) * ZV_TIMER_TICK_MS;
+    return when > now ? (int)(when - now) : 0;
+}
+
+//处理到now为止的所有tick，时间轮为空时直接跳到当前tick
+void zv_timer_expire(zv_timer_wheel *wheel, uint64_t now, void *ctx) {
+    uint64_t target = (now - wheel->start) / ZV_TIMER_TICK_MS;
+    while(wheel->tick < target) {
+        if(wheel->count == 0) {
+            wheel->tick = target;
+            break;
+        }
+        zv_timer_tick(wheel, ctx);
+    }
+}
+/*------------时间轮实现------------*/
@@ -0,0 +1,57 @@
+/*
+    分层时间轮，每个reactor线程一个，不加锁
+    为epoll_wait/io_uring提供等待超时，并在事件处理后执行到期的定时任务
+*/
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include <stdint.h>
+
+#define ZV_TIMER_LEVELS 4//时间轮层数
+#define ZV_TIMER_SLOT_BITS 6
+#define ZV_TIMER_SLOTS (1 << ZV_TIMER_SLOT_BITS)//每层的槽数
+#define ZV_TIMER_SLOT_MASK (ZV_TIMER_SLOTS - 1)
+#define ZV_TIMER_TICK_MS 10//时间轮精度，第0层覆盖0.64秒，4层共覆盖约46小时，更长的超时截断到最大值
+
+//定时任务回调，ctx为执行到期任务时传入的上下文（reactor），data为定时任务自身携带的数据（连接）
+typedef void (*zv_timer_cb)(void *ctx, void *data);
+
+//定时任务，嵌入在使用者的结构体中，不单独分配内存
+typedef struct zv_timer_s {
+    struct zv_timer_s *prev;
+    struct zv_timer_s *next;//不在时间轮中时为NULL
+    uint64_t expire;//到期的tick
+    zv_timer_cb cb;
+    void *data;
+} zv_timer;
+
+//时间轮，每个槽是一个以哨兵节点开头的双向循环链表，添加和删除都是O(1)
+typedef struct zv_timer_wheel_s {
+    zv_timer slots[ZV_TIMER_LEVELS][ZV_TIMER_SLOTS];
+    uint64_t start;//时间轮创建时的毫秒时间，tick从此刻开始计数
+    uint64_t tick;//已经处理到的tick
+    int count;//时间轮中的定时任务数量
+} zv_timer_wheel;
+
+//当前的单调时间，单位毫秒
+uint64_t zv_timer_now(void);
+
+//当前的单调时间，单位微秒，用于忙轮询等需要高精度计时的场合
+uint64_t zv_timer_now_us(void);
+
+//初始化时间轮
+void zv_timer_wheel_init(zv_timer_wheel *wheel, uint64_t now);
+
+//timeout毫秒后执行timer->cb，timer已在时间轮中时重新计时
+void zv_timer_add(zv_timer_wheel *wheel, zv_timer *timer, uint64_t timeout);
+
+//从时间轮中移除timer，timer不在时间轮中时不做任何操作
+void zv_timer_del(zv_timer_wheel *wheel, zv_timer *timer);
+
+//距离下一次需要处理时间轮的毫秒数，作为epoll_wait的超时，没有定时任务时返回-1
+int zv_timer_timeout(zv_timer_wheel *wheel, uint64_t now);
+
+//处理到now为止的所有tick，执行到期的定时任务
+void zv_timer_expire(zv_timer_wheel *wheel, uint64_t now, void *ctx);
+
+#endif
@@ -2,10 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include "array.h"
+#include "value.h"
 
 /*------------功能函数声明------------*/
-//array遍历查找，返回的是一个KV对
-kv_array_item_t *kv_array_search(kv_array_t *kv_addr, const char *key, kv_array_block_t *cur_blk);
+//array遍历查找，返回的是一个KV对，out_blk不为NULL时通过其返回KV对所在的块
+kv_array_item_t *kv_array_search(kv_array_t *kv_addr, kv_slice key, kv_array_block_t **out_blk);
 
 //在末尾创建新的存储KV对的内存块，返回创建的块指针
 kv_array_block_t *kv_array_create_block(kv_array_t *kv_addr);
@@ -13,8 +14,8 @@ kv_array_block_t *kv_array_create_block(kv_array_t *kv_addr);
 //释放给定的块
 int kv_array_free_block(kv_array_t *kv_addr, kv_array_block_t *blk);
 
-//找到第一个空节点，若全满就调用块创建函数创建一个新的块
-kv_array_item_t *kv_array_find_space(kv_array_t *kv_addr, kv_array_block_t *cur_blk);
+//找到第一个空节点，若全满就调用块创建函数创建一个新的块，out_blk返回空节点所在的块
+kv_array_item_t *kv_array_find_space(kv_array_t *kv_addr, kv_array_block_t **out_blk);
 /*------------功能函数声明------------*/
 
 
@@ -29,37 +30,40 @@ int kv_array_desy(kv_array_t* kv_addr);
 
 // 插入指令
 // 返回值：0表示成功、-1表示失败、-2表示已经有key
-int kv_array_set(kv_array_t* kv_addr, char** tokens);
+int kv_array_set(kv_array_t* kv_addr, kv_slice* tokens);
 
 // 查找指令
-char* kv_array_get(kv_array_t* kv_addr, char** tokens);
+char* kv_array_get(kv_array_t* kv_addr, kv_slice* tokens);
 
 // 删除指令，另外若当前块为空就释放当前块
 // 返回值：0成功，-1失败，-2没有
-int kv_array_delete(kv_array_t* kv_addr, char** tokens);
+int kv_array_delete(kv_array_t* kv_addr, kv_slice* tokens);
 
 // 计数指令
 int kv_array_count(kv_array_t* kv_addr);
 
 // 存在指令
 // 返回值：1存在，0没有
-int kv_array_exist(kv_array_t* kv_addr, char** tokens);
+int kv_array_exist(kv_array_t* kv_addr, kv_slice* tokens);
 
 /*------------KV功能函数声明------------*/
 
 
 /*------------功能函数定义------------*/
-//此处的cur_blk其实在下面的实现中是冗余的，可以尝试用于查找优化
-kv_array_item_t *kv_array_search(kv_array_t *kv_addr, const char *key, kv_array_block_t *cur_blk) {
-    if(kv_addr == NULL || key == NULL) {
+//out_blk用于删除时维护所在块的count
+kv_array_item_t *kv_array_search(kv_array_t *kv_addr, kv_slice key, kv_array_block_t **out_blk) {
+    if(kv_addr == NULL || key.data == NULL) {
         return NULL;
     }
     //从头部开始查找
-    cur_blk = kv_addr->head;
+    kv_array_block_t *cur_blk = kv_addr->head;
     while(cur_blk != NULL) {
         for(int index = 0; index < kv_array_block_size; index++) {
             //若存储的记录有效且等于key，则找到该记录
-            if(cur_blk->items[index].key != NULL && strcmp(cur_blk->items[index].key, key) == 0) {
+            if(cur_blk->items[index].key != NULL && kv_key_cmp(cur_blk->items[index].key, key) == 0) {
+                if(out_blk != NULL) {
+                    *out_blk = cur_blk;
+                }
                 return &(cur_blk->items[index]);
             }
         }
@@ -88,6 +92,13 @@ kv_array_block_t *kv_array_create_block(kv_array_t *kv_addr) {
         perror("end_blk create fail\n");
         return NULL;
     }
+    end_blk->items = (kv_array_item_t *)calloc(kv_array_block_size, sizeof(kv_array_item_t));
+    if(end_blk->items == NULL) {
+        free(end_blk);
+        end_blk = NULL;
+        perror("end_blk items create fail\n");
+        return NULL;
+    }
     //新分配块的初始化
     end_blk->next = NULL;
     end_blk->count = 0;
@@ -134,8 +145,8 @@ int kv_array_free_block(kv_array_t *kv_addr, kv_array_block_t *blk) {
 }
 
 //找到一个可以存储KV对的空位，若全满则创建一个新的块
-kv_array_item_t *kv_array_find_space(kv_array_t *kv_addr, kv_array_block_t *cur_blk) {
-    cur_blk = kv_addr->head;
+kv_array_item_t *kv_array_find_space(kv_array_t *kv_addr, kv_array_block_t **out_blk) {
+    kv_array_block_t *cur_blk = kv_addr->head;
     //若目前没有用于存储KV对的块,创建一个新块
     if(cur_blk == NULL) {
         cur_blk = kv_array_create_block(kv_addr);
@@ -143,6 +154,7 @@ kv_array_item_t *kv_array_find_space(kv_array_t *kv_addr, kv_array_block_t *cur_
             perror("find space : create new block fail\n");
             return NULL;
         }
+        *out_blk = cur_blk;
         return &(cur_blk->items[0]);
     }
     //从头开始查找
@@ -150,6 +162,7 @@ kv_array_item_t *kv_array_find_space(kv_array_t *kv_addr, kv_array_block_t *cur_
     while(cur_blk != NULL) {
         for(int index = 0; index < kv_array_block_size; index++) {
             if(cur_blk->items[index].key == NULL && cur_blk->items[index].value == NULL) {
+                *out_blk = cur_blk;
                 return &(cur_blk->items[index]);
             }
         }
@@ -163,6 +176,7 @@ kv_array_item_t *kv_array_find_space(kv_array_t *kv_addr, kv_array_block_t *cur_
         return NULL;
     }
     last_blk->next = cur_blk;
+    *out_blk = cur_blk;
     return &(cur_blk->items[0]);
 }
 /*------------功能函数定义------------*/
@@ -202,50 +216,49 @@ int kv_array_desy(kv_array_t *kv_addr) {
 
 //插入指令
 //tokens字符指针数组包含指令中的各个字段
-int kv_array_set(kv_array_t *kv_addr, char **tokens) {
+int kv_array_set(kv_array_t *kv_addr, kv_slice *tokens) {
     //array地址无效或set指令两个参数无效，返回-1
-    if(kv_addr == NULL || tokens[1] == NULL || tokens[2] == NULL) {
+    if(kv_addr == NULL || tokens[1].data == NULL || tokens[2].data == NULL) {
         perror("command set : invalid parameters\n");
         return -1;
     }
     //若已经存在该key，直接返回
     if(kv_array_search(kv_addr, tokens[1], NULL) != NULL) {
-        printf("key already existed!\n");
         return -2;
     }
     //复制key
-    char *key_copy = (char *)malloc(strlen(tokens[1]) + 1);//包含字符串末尾的空字符\0
+    char *key_copy = kv_key_new(tokens[1]);
     if(key_copy == NULL) {
         perror("set command : key kcopy fail\n");
         return -1;
     }
-    strncpy(key_copy, tokens[1], strlen(tokens[2]) + 1);
     //复制value
-    char *value_copy = (char *)malloc(strlen(tokens[2]) + 1);
+    char *value_copy = kv_value_new(tokens[2].data, tokens[2].len);
     if(value_copy == NULL) {
         perror("set command : value kcopy fail\n");
-        free(key_copy);//若value分配失败，释放key_copy
+        kv_key_free(key_copy);//若value分配失败，释放key_copy
         key_copy = NULL;
         return -1;
     }
-    strncpy(value_copy, tokens[2], strlen(tokens[2]) + 1);
     //找到array中第一个空KV条目，执行set
-    kv_array_block_t blk;
+    kv_array_block_t *blk = NULL;
     kv_array_item_t *item = kv_array_find_space(kv_addr, &blk);
     if(item == NULL) {
         perror("set fail : find_space for new KV fail\n");
+        kv_key_free(key_copy);
+        kv_value_unref(value_copy);
         return -1;
     }
     item->key = key_copy;
     item->value = value_copy;
     kv_addr->count++;
     //返回的空闲条目所在块指针成为blk
-    blk.count++;
+    blk->count++;
     return 0;
 }
 
 //查找指令
-char *kv_array_get(kv_array_t * kv_addr, char **tokens) {
+char *kv_array_get(kv_array_t * kv_addr, kv_slice *tokens) {
     kv_array_item_t *item = kv_array_search(kv_addr, tokens[1], NULL);
     if(item != NULL) {
         return item->value;
@@ -256,27 +269,26 @@ char *kv_array_get(kv_array_t * kv_addr, char **tokens) {
 }
 
 //删除指令，若删除KV条目使当前块为空则释放当前块
-int kv_array_delete(kv_array_t *kv_addr, char **tokens) {
-    kv_array_block_t blk;
+int kv_array_delete(kv_array_t *kv_addr, kv_slice *tokens) {
+    kv_array_block_t *blk = NULL;
     kv_array_item_t *item = kv_array_search(kv_addr, tokens[1], &blk);
     if(item == NULL) {
-        printf("key %s not exist\n", tokens[1]);
         return -2;
     }
     else {
         if(item->value) {
-            free(item->value);
+            kv_value_unref(item->value);
             item->value = NULL;
         }
         if(item->key) {
-            free(item->key);
+            kv_key_free(item->key);
             item->key = NULL;
         }
         kv_addr->count--;
-        blk.count--;//blk作为引用传入函数，其会被修改为指向当前删除条目的块
-        //当前块空且当前块不是除头节点外的最后一个块，回收当前块
-        if(blk.count == 0 && kv_addr->head != &blk) {
-            kv_array_free_block(kv_addr, &blk);
+        blk->count--;//blk通过search返回，指向当前删除条目所在的块
+        //当前块空且当前块不是头节点，回收当前块
+        if(blk->count == 0 && kv_addr->head != blk) {
+            kv_array_free_block(kv_addr, blk);
         }
         return 0;
     }
@@ -288,7 +300,22 @@ int kv_array_count(kv_array_t *kv_addr) {
 }
 
 //存在指令
-int kv_array_exist(kv_array_t *kv_addr, char **tokens) {
+int kv_array_exist(kv_array_t *kv_addr, kv_slice *tokens) {
     return (kv_array_search(kv_addr, tokens[1], NULL) != NULL);
 }
+
+//插入或覆盖指令
+//key已存在时只替换value指针，不改变数据结构
+int kv_array_upsert(kv_array_t *kv_addr, kv_slice *tokens, char **old) {
+    kv_array_item_t *item = kv_array_search(kv_addr, tokens[1], NULL);
+    if(item == NULL) {
+        return (kv_array_set(kv_addr, tokens) == 0) ? 0 : -1;
+    }
+    char *value = kv_value_new(tokens[2].data, tokens[2].len);
+    if(value == NULL) {
+        return -1;
+    }
+    kv_value_replace(&item->value, value, old);
+    return 1;
+}
 /*------------KV功能函数定义------------*/
\ No newline at end of file
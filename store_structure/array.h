@@ -1,6 +1,8 @@
 #ifndef _ARRAY_H
 #define _ARRAY_H
 
+#include "value.h"
+
 #define kv_array_block_size 32//单个块存储的最多键值对数量
 
 //键值对结构体
@@ -31,19 +33,23 @@ int kv_array_init(kv_array_t *kv_addr);
 int kv_array_desy(kv_array_t *kv_addr);
 
 //插入指令：有就报错，没有就创建
-int kv_array_set(kv_array_t *kv_addr, char **tokens);
+int kv_array_set(kv_array_t *kv_addr, kv_slice *tokens);
 
 //查找指令
-char *kv_array_get(kv_array_t *kv_addr, char **tokens);
+char *kv_array_get(kv_array_t *kv_addr, kv_slice *tokens);
 
 //删除指令
-int kv_array_delete(kv_array_t *kv_addr, char **tokens);
+int kv_array_delete(kv_array_t *kv_addr, kv_slice *tokens);
 
 //计数指令
 int kv_array_count(kv_array_t *kv_addr);
 
 //检查存在与否
-int kv_array_exist(kv_array_t *kv_addr, char **tokens);
+int kv_array_exist(kv_array_t *kv_addr, kv_slice *tokens);
+
+//插入或覆盖指令，key已存在时只替换value，old不为NULL时通过old返回旧value的引用，由调用者释放
+//返回值：0插入了新key，1覆盖了已有的key，-1失败
+int kv_array_upsert(kv_array_t *kv_addr, kv_slice *tokens, char **old);
 
 /*------------KV功能函数声明------------*/
 #endif
\ No newline at end of file
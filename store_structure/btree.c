@@ -5,6 +5,7 @@
 #include <errno.h>
 
 #include "btree.h"
+#include "value.h"
 
 
 /*------------Btree操作和KV协议函数声明------------*/
@@ -43,7 +44,7 @@ btree_node *btree_root_split(btree *T);
 btree_node *btree_child_split(btree *T, btree_node *cur, int idx);
 
 //插入元素
-int btree_insert_key(btree *T, B_KEY_SUB_TYPE key, B_VALUE_SUB_TYPE value);
+int btree_insert_key(btree *T, B_KEY_ARG_TYPE key, B_VALUE_ARG_TYPE value);
 
 /*------插入------*/
 
@@ -63,7 +64,7 @@ btree_node *btree_precursor_node(btree *T, btree_node *cur, int idx_key);
 btree_node *btree_successor_node(btree *T, btree_node *cur, int idx_key);
 
 //删除元素
-int btree_delete_key(btree *T, B_KEY_SUB_TYPE key);
+int btree_delete_key(btree *T, B_KEY_ARG_TYPE key);
 
 /*------删除------*/
 
@@ -71,7 +72,7 @@ int btree_delete_key(btree *T, B_KEY_SUB_TYPE key);
 /*------查找------*/
 
 //查找key
-btree_node *btree_search_key(btree *T, B_KEY_SUB_TYPE key);
+btree_node *btree_search_key(btree *T, B_KEY_ARG_TYPE key);
 
 /*------查找------*/
 
@@ -243,6 +244,7 @@ btree_node *btree_root_split(btree *T) {
 #elif KV_BTYPE_CHAR_CHAR
     //取分裂后的原根节点的最后一个元素作为新的根节点
     new_root->keys[0] = T->root_node->keys[T->root_node->kv_count - 1];
+    new_root->values[0] = T->root_node->values[T->root_node->kv_count - 1];
     T->root_node->keys[T->root_node->kv_count - 1] = NULL;
     T->root_node->values[T->root_node->kv_count - 1] = NULL;
 #endif
@@ -285,10 +287,11 @@ btree_node *btree_child_split(btree *T, btree_node *cur, int idx) {
     full_child->children[T->m - 1] = NULL;
 
     //将cur的第idx+1到最后一个元素全部向后移，以容纳分裂得到的新节点new_child
+    //孩子指针比元素多一个，元素i后移到i+1时其右孩子i+1也后移到i+2
     for(i = cur->kv_count; i > idx; i--) {
         cur->keys[i] = cur->keys[i - 1];
         cur->values[i] = cur->values[i - 1];
-        cur->children[i] = cur->children[i - 1];
+        cur->children[i + 1] = cur->children[i];
     }
     cur->children[idx + 1] = new_child;
     //将被分裂孩子节点中最大的元移动到父节点，注意节点中关键字的索引大小等于其左边孩子的索引大小
@@ -308,7 +311,7 @@ btree_node *btree_child_split(btree *T, btree_node *cur, int idx) {
 }
 
 //插入元素，先判断是否需要分裂，插入操作必然发生在叶子节点
-int btree_insert_key(btree *T, B_KEY_SUB_TYPE key, B_VALUE_SUB_TYPE value) {
+int btree_insert_key(btree *T, B_KEY_ARG_TYPE key, B_VALUE_ARG_TYPE value) {
     btree_node *cur = T->root_node;
     //判断输入是否合法
 #if KV_BTYPE_INT_INT
@@ -316,7 +319,7 @@ int btree_insert_key(btree *T, B_KEY_SUB_TYPE key, B_VALUE_SUB_TYPE value) {
         return -1;
     }
 #elif KV_BTYPE_CHAR_CHAR
-    if(key == NULL || value == NULL) {
+    if(key.data == NULL || value.data == NULL) {
         perror("btree_insert_key : Invalid input\n");
         return -1;
     }
@@ -330,20 +333,18 @@ int btree_insert_key(btree *T, B_KEY_SUB_TYPE key, B_VALUE_SUB_TYPE value) {
 #elif KV_BTYPE_CHAR_CHAR
         //由于传入的是指针类型，进行参数赋值操作
         //拷贝操作使B树拥有自己的独立拷贝，保证安全性和完整性
-        char *key_copy = (char *)malloc(strlen(key) + 1);
+        char *key_copy = kv_key_new(key);
         if(key_copy == NULL) {
             perror("key_copy : malloc fail\n");
             return -1;
         }
-        strncpy(key_copy, key, strlen(key) + 1);
-        char *value_copy = (char *)malloc(strlen(value) + 1);
+        char *value_copy = kv_value_new(value.data, value.len);
         if(value_copy == NULL) {
             perror("value_copy : malloc fail\n");
-            free(key_copy);
+            kv_key_free(key_copy);
             key_copy = NULL;
             return -1;
         }
-        strncpy(value_copy, value, str(value) + 1);
         new->keys[0] = key_copy;
         new->values[0] = value_copy;
 #endif
@@ -376,11 +377,11 @@ int btree_insert_key(btree *T, B_KEY_SUB_TYPE key, B_VALUE_SUB_TYPE value) {
                     next_index = cur->kv_count;
                 }
 #elif KV_BTYPE_CHAR_CHAR
-                if(strcmp(key, cur->keys[i]) == 0) {
-                    printf("Insert key:%s - value:%s : already existed\n", key, value);
+                int cmp = kv_key_cmp(cur->keys[i], key);
+                if(cmp == 0) {
                     return -2;
                 }
-                else if(strcmp(key, cur->keys[i]) < 0) {//key小于cur->keys[i]，应当插入该键的左子树中
+                else if(cmp > 0) {//key小于cur->keys[i]，应当插入该键的左子树中
                     next_index = i;
                     break;
                 }
@@ -405,7 +406,6 @@ int btree_insert_key(btree *T, B_KEY_SUB_TYPE key, B_VALUE_SUB_TYPE value) {
         for (i = 0; i < cur->kv_count; i++) {
 #if KV_BTYPE_INT_INT
             if(key == cur->keys[i]) {
-                printf("Insert key:%s - value:%s : already existed\n", key, value);
                 return -2;
             }
             else if(key < cur->keys[i]) {
@@ -416,11 +416,11 @@ int btree_insert_key(btree *T, B_KEY_SUB_TYPE key, B_VALUE_SUB_TYPE value) {
                 pos = cur->kv_count;
             }
 #elif KV_BTYPE_CHAR_CHAR
-            if(strcmp(key, cur->keys[i]) == 0) {
-                printf("Insert key:%s - value:%s : already existed\n", key, value);
+            int cmp = kv_key_cmp(cur->keys[i], key);
+            if(cmp == 0) {
                 return -2;
             }
-            else if(strcmp(key, cur->keys[i]) < 0) {
+            else if(cmp > 0) {
                 pos = i;
                 break;
             }
@@ -431,21 +431,19 @@ int btree_insert_key(btree *T, B_KEY_SUB_TYPE key, B_VALUE_SUB_TYPE value) {
         }
         //插入元素，只有当key-value为char *_char *类型时候需要进行参数独立拷贝
 #if KV_BTYPE_CHAR_CHAR
-        char *key_copy = (char *)malloc(strlen(key) + 1);
+        char *key_copy = kv_key_new(key);
         if(key_copy == NULL) {
             perror("key_copy : malloc failed\n");
             return -1;
         }
-        strncpy(key_copy, key, strlen(key) + 1);
 
-        char *value_copy = (char *)malloc(strlen(value) + 1);
+        char *value_copy = kv_value_new(value.data, value.len);
         if(value_copy == NULL) {
             perror("value_copy : malloc failed\n");
-            free(key_copy);
+            kv_key_free(key_copy);
             key_copy = NULL;
             return -1;
         }
-        strncpy(value_copy, value, strlen(value) + 1);
 #endif
         if(pos == cur->kv_count) {//若插入末尾，不需要移动元素
 #if KV_BTYPE_INT_INT
@@ -580,10 +578,10 @@ btree_node *btree_merge(btree *T, btree_node *cur, int idx) {
     left->children[left->kv_count] = right->children[right->kv_count];
     //销毁右孩子
     btree_node_destroy(right);
-    //若cur节点为B树的根节点且当前为空，销毁
+    //若cur节点为B树的根节点且当前为空，销毁，合并后的left成为新的根节点
     if(T->root_node == cur && cur->kv_count == 0) {
         btree_node_destroy(cur);
-        T->root_node = NULL;
+        T->root_node = left;
     }
     //若原来的根节点被销毁，返回的left将作为新的根节点
     return left;//返回合并后的节点指针
@@ -591,6 +589,7 @@ btree_node *btree_merge(btree *T, btree_node *cur, int idx) {
 
 //找出当前节点索引为idx_key的元素的前驱节点
 btree_node *btree_precursor_node(btree *T, btree_node *cur, int idx_key) {
+    (void)T;
     if(cur->leaf == 0) {
         //搜索cur的左子树
         cur = cur->children[idx_key];
@@ -604,6 +603,7 @@ btree_node *btree_precursor_node(btree *T, btree_node *cur, int idx_key) {
 
 //找出当前节点索引为idx_key的元素的后继节点
 btree_node *btree_successor_node(btree *T, btree_node *cur, int idx_key) {
+    (void)T;
     //若cur非叶节点
     if(cur->leaf == 0) {
         //搜索cur的右子树
@@ -617,12 +617,12 @@ btree_node *btree_successor_node(btree *T, btree_node *cur, int idx_key) {
 }
 
 //删除元素（key所指示的键值对），检查是否需要先合并或借位，再删除，删除必定发生在叶子节点
-int btree_delete_key(btree *T, B_KEY_SUB_TYPE key) {
+int btree_delete_key(btree *T, B_KEY_ARG_TYPE key) {
 #if KV_BTYPE_INT_INT
     if(T->root_node != NULL && key > 0)
 #elif KV_BTYPE_CHAR_CHAR
     //树非空，键有效
-    if(T->root_node != NULL && key != NULL)
+    if(T->root_node != NULL && key.data != NULL)
 #endif
     {
         btree_node *cur = T->root_node;
@@ -635,7 +635,7 @@ int btree_delete_key(btree *T, B_KEY_SUB_TYPE key) {
             if(key < cur->keys[0])
 #elif KV_BTYPE_CHAR_CHAR
             //边界1：比当前节点中最小的元素还小
-            if(strcmp(key, cur->keys[0]) < 0)
+            if(kv_key_cmp(cur->keys[0], key) > 0)
 #endif
             {
                 //下一步搜索cur->keys[0]的左子树
@@ -646,7 +646,7 @@ int btree_delete_key(btree *T, B_KEY_SUB_TYPE key) {
             else if(key > cur->keys[cur->num - 1])
 #elif KV_BTYPE_CHAR_CHAR
             //边界2：比当前节点中最大的元素还大
-            else if(strcmp(key, cur->keys[cur->kv_count - 1]) > 0)
+            else if(kv_key_cmp(cur->keys[cur->kv_count - 1], key) < 0)
 #endif
             {
                 //下一步搜索keys[cur->kv_count]的右子树
@@ -661,7 +661,7 @@ int btree_delete_key(btree *T, B_KEY_SUB_TYPE key) {
 #if KV_BTYPE_INT_INT
                     if(key == cur->keys[i])
 #elif KV_BTYPE_CHAR_CHAR
-                    if(strcmp(key, cur->keys[i]) == 0)//要删除的元素在非叶节点中找到，不可直接删除，终止搜索，转换为删除叶节点上的元素
+                    if(kv_key_cmp(cur->keys[i], key) == 0)//要删除的元素在非叶节点中找到，不可直接删除，终止搜索，转换为删除叶节点上的元素
 #endif
                     {
                         //选择向元素数量更少的孩子节点搜索删除对象，并让元素数量更多的节点成为兄弟节点
@@ -679,7 +679,7 @@ int btree_delete_key(btree *T, B_KEY_SUB_TYPE key) {
 #if KV_BTYPE_INT_INT
                     else if((i < cur->kv_count - 1) && (key > cur->keys[i]) && (key < cur->keys[i + 1]))
 #elif KV_BTYPE_CHAR_CHAR
-                    else if((i < cur->kv_count - 1) && (strcmp(key, cur->keys[i]) > 0) && (strcmp(key, cur->keys[i + 1]) < 0))//要删除的元素不再当前节点，继续向叶节点搜索
+                    else if((i < cur->kv_count - 1) && (kv_key_cmp(cur->keys[i], key) < 0) && (kv_key_cmp(cur->keys[i + 1], key) > 0))//要删除的元素不再当前节点，继续向叶节点搜索
 #endif
                     {
                         idx_next = i + 1;//只能向child[i + 1]孩子搜索，此时可以选择children[i]或children[i + 2]作为兄弟节点
@@ -711,7 +711,7 @@ int btree_delete_key(btree *T, B_KEY_SUB_TYPE key) {
             else if(cur->keys[idx_key] == key)
 #elif KV_BTYPE_CHAR_CHAR
             //在cur中找到待删除元素
-            else if(strcmp(cur->keys[idx_key], key) == 0)
+            else if(kv_key_cmp(cur->keys[idx_key], key) == 0)
 #endif
             {
                 btree_node *pre;
@@ -753,7 +753,7 @@ int btree_delete_key(btree *T, B_KEY_SUB_TYPE key) {
 #if KV_BTYPE_INT_INT
             if(cur->keys[i] == key)
 #elif KV_BTYPE_CHAR_CHAR
-            if(strcmp(cur->keys[i], key) == 0)//找到待删除元素，直接删除，注意是否需要销毁节点
+            if(kv_key_cmp(cur->keys[i], key) == 0)//找到待删除元素，直接删除，注意是否需要销毁节点
 #endif      
             {
                 if(cur->kv_count == 1) {//此时是根节点且只剩下一个元素，因为非根节点都有元素数量限制
@@ -830,7 +830,10 @@ void btree_traversal(btree *T) {
 
 //查找key，返回其所在节点
 #if KV_BTYPE_INT_INT
-btree_node* btree_search_key(btree *T, B_KEY_SUB_TYPE key){
+btree_node* btree_search_key(btree *T, B_KEY_ARG_TYPE key){
+    if(T->root_node == NULL) {
+        return NULL;
+    }
     if(key > 0){
         btree_node *cur = T->root_node;
         // 先寻找是否为非叶子节点
@@ -862,22 +865,26 @@ btree_node* btree_search_key(btree *T, B_KEY_SUB_TYPE key){
     return NULL;
 }
 #elif KV_BTYPE_CHAR_CHAR
-btree_node *btree_search_key(btree *T, B_KEY_SUB_TYPE key) {
-    if(key != NULL) {
+btree_node *btree_search_key(btree *T, B_KEY_ARG_TYPE key) {
+    //删除最后一个键后根节点被释放，空树直接返回NULL
+    if(T->root_node == NULL) {
+        return NULL;
+    }
+    if(key.data != NULL) {
         btree_node *cur = T->root_node;
         while(cur->leaf == 0) {
-            if(strcmp(key, cur->keys[0]) < 0) {
+            if(kv_key_cmp(cur->keys[0], key) > 0) {
                 cur = cur->children[0];
             }
-            else if(strcmp(key, cur->keys[cur->kv_count - 1]) > 0) {
+            else if(kv_key_cmp(cur->keys[cur->kv_count - 1], key) < 0) {
                 cur = cur->children[cur->kv_count];
             }
             else {
                 for(int i = 0; i < cur->kv_count; i++) {
-                    if(strcmp(cur->keys[i], key) == 0) {
+                    if(kv_key_cmp(cur->keys[i], key) == 0) {
                         return cur;
                     }
-                    else if((i < cur->kv_count - 1) && (strcmp(key, cur->keys[i]) > 0) && (strcmp(key, cur->keys[i + 1]) < 0)) {
+                    else if((i < cur->kv_count - 1) && (kv_key_cmp(cur->keys[i], key) < 0) && (kv_key_cmp(cur->keys[i + 1], key) > 0)) {
                         cur = cur->children[i + 1];
                     }
                 }
@@ -886,7 +893,7 @@ btree_node *btree_search_key(btree *T, B_KEY_SUB_TYPE key) {
 
         if(cur->leaf == 1) {
             for(int i = 0; i < cur->kv_count; i++) {
-                if(strcmp(cur->keys[i], key) == 0) {
+                if(kv_key_cmp(cur->keys[i], key) == 0) {
                     return cur;
                 }
             }
@@ -923,16 +930,16 @@ int kv_btree_desy(kv_btree_t *kv_addr) {
 }
 
 //插入指令
-int kv_btree_set(kv_btree_t *kv_addr, char **tokens) {
+int kv_btree_set(kv_btree_t *kv_addr, kv_slice *tokens) {
     return btree_insert_key(kv_addr, tokens[1], tokens[2]);
 }
 
 //查找指令
-char *kv_btree_get(kv_btree_t *kv_addr, char **tokens) {
+char *kv_btree_get(kv_btree_t *kv_addr, kv_slice *tokens) {
     btree_node *node = btree_search_key(kv_addr, tokens[1]);
     if(node != NULL) {
         for(int i = 0; i < node->kv_count; i++) {
-            if(strcmp(node->keys[i], tokens[1]) == 0) {
+            if(kv_key_cmp(node->keys[i], tokens[1]) == 0) {
                 return node->values[i];
             }
         }
@@ -941,7 +948,7 @@ char *kv_btree_get(kv_btree_t *kv_addr, char **tokens) {
 }
 
 //删除指令
-int kv_btree_delete(kv_btree_t *kv_addr, char **tokens) {
+int kv_btree_delete(kv_btree_t *kv_addr, kv_slice *tokens) {
     return btree_delete_key(kv_addr, tokens[1]);
 }
 
@@ -951,7 +958,26 @@ int kv_btree_count(kv_btree_t *kv_addr) {
 }
 
 //存在指令
-int kv_btree_exist(kv_btree_t *kv_addr, char **tokens) {
+int kv_btree_exist(kv_btree_t *kv_addr, kv_slice *tokens) {
     return (btree_search_key(kv_addr, tokens[1]) != NULL);
 }
+
+//插入或覆盖指令
+//key已存在时只替换节点中对应位置的value指针，不分裂、合并节点
+int kv_btree_upsert(kv_btree_t *kv_addr, kv_slice *tokens, char **old) {
+    btree_node *node = btree_search_key(kv_addr, tokens[1]);
+    if(node != NULL) {
+        for(int i = 0; i < node->kv_count; i++) {
+            if(kv_key_cmp(node->keys[i], tokens[1]) == 0) {
+                char *value = kv_value_new(tokens[2].data, tokens[2].len);
+                if(value == NULL) {
+                    return -1;
+                }
+                kv_value_replace(&node->values[i], value, old);
+                return 1;
+            }
+        }
+    }
+    return (btree_insert_key(kv_addr, tokens[1], tokens[2]) == 0) ? 0 : -1;
+}
 /*------------KV协议函数定义------------*/
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef _BTREE_H
 #define _BTREE_H
 
+#include "value.h"
+
 //使用键值对的数据类型：根据使用的键值对类型选择将其中一个置1，另一个置0
 #define KV_BTYPE_INT_INT 0//INT KEY; INT VALUE
 #define KV_BTYPE_CHAR_CHAR 1//CHAR *KEY; VHAR *VALUE，此类型通过比较字典序使得节点内元素有序
@@ -14,11 +16,15 @@ typedef int * B_KEY_TYPE;//存储key的数据容器类型
 typedef int * B_VALUE_TYPE;//存储value的数据容器类型
 typedef int B_KEY_SUB_TYPE;//数据容器中单个key元素的类型
 typedef int B_VALUE_SUB_TYPE;//数据容器中单个value元素的类型
+typedef int B_KEY_ARG_TYPE;//插入、查找、删除时传入的key的类型
+typedef int B_VALUE_ARG_TYPE;//插入时传入的value的类型
 #elif KV_BTYPE_CHAR_CHAR
 typedef char ** B_KEY_TYPE;//存储key的数据容器类型
 typedef char ** B_VALUE_TYPE;//存储value的数据结构类型
 typedef char * B_KEY_SUB_TYPE;//数据容器中单个key元素的类型
 typedef char * B_VALUE_SUB_TYPE;//数据容器中单个value元素的类型
+typedef kv_slice B_KEY_ARG_TYPE;//插入、查找、删除时传入的key的类型，带长度，不以'\0'结尾
+typedef kv_slice B_VALUE_ARG_TYPE;//插入时传入的value的类型
 #endif
 
 //B树节点结构体
@@ -48,18 +54,22 @@ int kv_btree_init(kv_btree_t *kv_addr, int m);
 int kv_btree_desy(kv_btree_t *kv_addr);
 
 //插入指令
-int kv_btree_set(kv_btree_t *kv_addr, char **tokens);
+int kv_btree_set(kv_btree_t *kv_addr, kv_slice *tokens);
 
 //查找指令
-char *kv_btree_get(kv_btree_t *kv_addr, char **tokens);
+char *kv_btree_get(kv_btree_t *kv_addr, kv_slice *tokens);
 
 //删除指令
-int kv_btree_delete(kv_btree_t *kv_addr, char **tokens);
+int kv_btree_delete(kv_btree_t *kv_addr, kv_slice *tokens);
 
 //计数指令
 int kv_btree_count(kv_btree_t *kb_addr);
 
 //存在指令
-int kv_btree_exist(kv_btree_t *kv_addr, char **tokens);
+int kv_btree_exist(kv_btree_t *kv_addr, kv_slice *tokens);
+
+//插入或覆盖指令，key已存在时只替换value，old不为NULL时通过old返回旧value的引用，由调用者释放
+//返回值：0插入了新key，1覆盖了已有的key，-1失败
+int kv_btree_upsert(kv_btree_t *kv_addr, kv_slice *tokens, char **old);
 /*------------KV功能函数声明------------*/
 #endif
\ No newline at end of file
@@ -3,14 +3,15 @@
 #include <stdlib.h>
 
 #include "dhash.h"
+#include "value.h"
 
 /*------------dhash函数声明------------*/
 
 //计算哈希值
-static int dhash_function(DH_KEY_TYPE key, int size);
+static int dhash_function(DH_KEY_ARG_TYPE key, int size);
 
 //创建哈希节点
-dhash_node_t *dhash_node_create(DH_KEY_TYPE key, DH_VALUE_TYPE value);
+dhash_node_t *dhash_node_create(DH_KEY_ARG_TYPE key, DH_VALUE_ARG_TYPE value);
 
 //销毁哈希节点
 int dhash_node_desy(dhash_node_t *node);
@@ -22,13 +23,13 @@ int dhash_table_init(dhash_table_t *dhash, int size);
 int dhash_table_dey(dhash_table_t *dhash);
 
 //插入元素
-int dhash_table_insert(dhash_table_t *dhash, DH_KEY_TYPE key, DH_VALUE_TYPE value);
+int dhash_table_insert(dhash_table_t *dhash, DH_KEY_ARG_TYPE key, DH_VALUE_ARG_TYPE value);
 
 //查找元素
-int dhash_table_search(dhash_table_t *dhash, DH_KEY_TYPE key);
+int dhash_table_search(dhash_table_t *dhash, DH_KEY_ARG_TYPE key);
 
 //删除元素
-int dhash_node_delete(dhash_table_t *dhash, DH_KEY_TYPE key);
+int dhash_node_delete(dhash_table_t *dhash, DH_KEY_ARG_TYPE key);
 
 //打印哈希表
 int dhash_table_print(dhash_table_t *dhash);
@@ -39,38 +40,36 @@ int dhash_table_print(dhash_table_t *dhash);
 /*------------函数定义------------*/
 
 //计算哈希值
-static int dhash_function(DH_KEY_TYPE key, int size) {
+static int dhash_function(DH_KEY_ARG_TYPE key, int size) {
     unsigned long int sum = 0;
-    for (int i = 0; i < strlen(key); i++) {
-        sum = sum * 37 + key[i];//字节的ASCII值加权和计算方法
+    for (size_t i = 0; i < key.len; i++) {
+        sum = sum * 37 + key.data[i];//字节的ASCII值加权和计算方法
     }
     sum = sum % size;
     return (int)sum;
 }
 
 //创建哈希表节点
-dhash_node_t *dhash_node_create(DH_KEY_TYPE key, DH_VALUE_TYPE value) {
+dhash_node_t *dhash_node_create(DH_KEY_ARG_TYPE key, DH_VALUE_ARG_TYPE value) {
     dhash_node_t *node = (dhash_node_t *)calloc(1, sizeof(dhash_node_t));
     if(!node) {
         return NULL;
     }
     //传入的是指针，独立拷贝操作
-    char *key_copy = (char *)calloc(strlen(key) + 1, sizeof(char));
+    char *key_copy = kv_key_new(key);
     if(key_copy == NULL) {
         free(node);
         node = NULL;
         return NULL;
     }
-    char *value_copy = (char *)calloc(strlen(value) + 1, sizeof(char));
+    char *value_copy = kv_value_new(value.data, value.len);
     if(value_copy == NULL) {
-        free(key_copy);
+        kv_key_free(key_copy);
         key_copy = NULL;
         free(node);
         node = NULL;
         return NULL;
     }
-    strncpy(key_copy, key, strlen(key) + 1);
-    strncpy(value_copy, value, strlen(value) + 1);
     node->key = key_copy;
     node->value = value_copy;
     return node;
@@ -82,11 +81,11 @@ int dhash_node_desy(dhash_node_t *node) {
         return -1;
     }
     if(node->value) {
-        free(node->value);
+        kv_value_unref(node->value);
         node->value = NULL;
     }
     if(node->key) {
-        free(node->key);
+        kv_key_free(node->key);
         node->key = NULL;
     }
     free(node);
@@ -134,8 +133,8 @@ int dhash_table_desy(dhash_table_t *dhash) {
 }
 
 //插入元素
-int dhash_node_insert(dhash_table_t *dhash, DH_KEY_TYPE key, DH_VALUE_TYPE value) {
-    if (!dhash || !key || !value) {
+int dhash_node_insert(dhash_table_t *dhash, DH_KEY_ARG_TYPE key, DH_VALUE_ARG_TYPE value) {
+    if (!dhash || !key.data || !value.data) {
         return -1;
     }
     //检查是否需要扩展哈希表，若使用容量超过总容量1/2
@@ -148,7 +147,7 @@ int dhash_node_insert(dhash_table_t *dhash, DH_KEY_TYPE key, DH_VALUE_TYPE value
         //将元素迁移到新的哈希表中
         for(int i = 0;i < dhash->max_size; i++) {
             if(dhash->nodes[i] != NULL) {
-                ret = dhash_node_insert(&new_table, dhash->nodes[i]->key, dhash->nodes[i]->value);
+                ret = dhash_node_insert(&new_table, kv_key_slice(dhash->nodes[i]->key), kv_key_slice(dhash->nodes[i]->value));
                 if(ret != 0) {
                     return ret;
                 }
@@ -170,7 +169,7 @@ int dhash_node_insert(dhash_table_t *dhash, DH_KEY_TYPE key, DH_VALUE_TYPE value
     //扩容检查完毕，寻找插入新节点的位置
     int index = dhash_function(key, dhash->max_size);
     while(dhash->nodes[index] != NULL) {
-        if(dhash->nodes[index]->key != NULL && strcmp(dhash->nodes[index]->key, key) != 0) {
+        if(dhash->nodes[index]->key != NULL && kv_key_cmp(dhash->nodes[index]->key, key) != 0) {
             //循环寻找线性探测再散列可以利用的空位
             if(index == dhash->max_size - 1) {
                 index = 0;//若遍历到哈希表末尾，重新回到哈希表开头
@@ -180,7 +179,7 @@ int dhash_node_insert(dhash_table_t *dhash, DH_KEY_TYPE key, DH_VALUE_TYPE value
             }
         }
         //待插入元素已经存在于哈希表中
-        else if(dhash->nodes[index]->key != NULL && strcmp(dhash->nodes[index]->key, key) == 0){
+        else if(dhash->nodes[index]->key != NULL && kv_key_cmp(dhash->nodes[index]->key, key) == 0){
             return -2;
         }
     }
@@ -195,11 +194,11 @@ int dhash_node_insert(dhash_table_t *dhash, DH_KEY_TYPE key, DH_VALUE_TYPE value
 }
 
 //查找元素
-int dhash_node_search(dhash_table_t *dhash, DH_KEY_TYPE key) {
+int dhash_node_search(dhash_table_t *dhash, DH_KEY_ARG_TYPE key) {
     int index = dhash_function(key, dhash->max_size);
     for (int i = 0; i < dhash->max_size; i++) {
         if(dhash->nodes[index] != NULL) {
-            if(strcmp(dhash->nodes[index]->key, key) == 0) {
+            if(kv_key_cmp(dhash->nodes[index]->key, key) == 0) {
                 break;
             }
             //根据处理冲突的方式，循环向后查找
@@ -212,7 +211,7 @@ int dhash_node_search(dhash_table_t *dhash, DH_KEY_TYPE key) {
         }
     }
     //若已经搜索到空位了，且当前位置键值不等于需要查找的键，未找到
-    if(dhash->nodes[index] == NULL || (strcmp(dhash->nodes[index]->key, key) != 0)) {
+    if(dhash->nodes[index] == NULL || (kv_key_cmp(dhash->nodes[index]->key, key) != 0)) {
         return -1;
     }
     else {
@@ -221,7 +220,7 @@ int dhash_node_search(dhash_table_t *dhash, DH_KEY_TYPE key) {
 }
 
 //删除元素
-int dhash_node_delete(dhash_table_t *dhash, DH_KEY_TYPE key) {
+int dhash_node_delete(dhash_table_t *dhash, DH_KEY_ARG_TYPE key) {
     //首先查看是否需要缩小哈希表，缩小倍率同扩容倍率，若使用空间小于1/4总容量，缩容，但是又不能小于初始化容量
     if((dhash->count < (dhash->max_size >> 2)) && (dhash->max_size > DHASH_INIT_TABLE_SIZE)) {
         dhash_table_t new_table;
@@ -231,7 +230,7 @@ int dhash_node_delete(dhash_table_t *dhash, DH_KEY_TYPE key) {
         }
         for (int i = 0; i < dhash->max_size; i++) {
             if(dhash->nodes[i] != NULL) {
-                ret = dhash_node_insert(&new_table, dhash->nodes[i]->key, dhash->nodes[i]->value);
+                ret = dhash_node_insert(&new_table, kv_key_slice(dhash->nodes[i]->key), kv_key_slice(dhash->nodes[i]->value));
                 if(ret != 0) {
                     return ret;
                 }
@@ -299,27 +298,27 @@ int kv_dhash_desy(kv_dhash_t *kv_addr) {
 }
 
 //插入指令
-int kv_dhash_set(dhash_table_t *kv_addr, char **tokens) {
-    if(kv_addr == NULL || tokens == NULL || tokens[1] == NULL || tokens[2] == NULL) {
+int kv_dhash_set(dhash_table_t *kv_addr, kv_slice *tokens) {
+    if(kv_addr == NULL || tokens == NULL || tokens[1].data == NULL || tokens[2].data == NULL) {
         return -1;
     }
     return dhash_node_insert(kv_addr, tokens[1], tokens[2]);
 }
 
 //查找指令
-char *kv_dhash_get(kv_dhash_t *kv_addr, char **tokens) {
-    if(kv_addr == NULL || tokens == NULL || tokens[1] == NULL) {
+char *kv_dhash_get(kv_dhash_t *kv_addr, kv_slice *tokens) {
+    if(kv_addr == NULL || tokens == NULL || tokens[1].data == NULL) {
         return NULL;
     }
     int index = dhash_node_search(kv_addr, tokens[1]);
     if(index >= 0) {
-        return kv_addr->nodes[index];
+        return kv_addr->nodes[index]->value;
     }
     return NULL;
 }
 
 //删除指令
-int kv_dhash_delete(kv_dhash_t *kv_addr, char **tokens) {
+int kv_dhash_delete(kv_dhash_t *kv_addr, kv_slice *tokens) {
     return dhash_node_delete(kv_addr, tokens[1]);
 }
 
@@ -329,8 +328,23 @@ int kv_dhash_count(kv_dhash_t *kv_addr) {
 }
 
 //存在指令
-int kv_dhash_exist(kv_dhash_t *kv_addr, char **tokens) {
+int kv_dhash_exist(kv_dhash_t *kv_addr, kv_slice *tokens) {
     return (dhash_node_search(kv_addr, tokens[1]) >= 0);
 }
 
+//插入或覆盖指令
+//key已存在时只替换value指针，不改变数据结构
+int kv_dhash_upsert(kv_dhash_t *kv_addr, kv_slice *tokens, char **old) {
+    int index = dhash_node_search(kv_addr, tokens[1]);
+    if(index < 0) {
+        return (dhash_node_insert(kv_addr, tokens[1], tokens[2]) == 0) ? 0 : -1;
+    }
+    char *value = kv_value_new(tokens[2].data, tokens[2].len);
+    if(value == NULL) {
+        return -1;
+    }
+    kv_value_replace(&kv_addr->nodes[index]->value, value, old);
+    return 1;
+}
+
 /*------------KV函数定义------------*/
\ No newline at end of file
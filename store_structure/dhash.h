@@ -1,6 +1,8 @@
 #ifndef _DHASH_H
 #define _DHASH_H
 
+#include "value.h"
+
 //虽说提供了两种数据类型的选择，但在实现中并未使用INT_INT类型的键值对，此类型条件判断简单且与CHAR_CHAR类型大同小异
 #define KV_DHTYPE_INT_INT 0
 #define KV_DHTYPE_CHAR_CHAR 1
@@ -11,12 +13,16 @@
 #define DHASH_GROW_FACTOR 2//动态哈希表的扩展/收缩倍数
 
 //键值对结构体
-#if KV_DHTYPE_INT_INT 0
+#if KV_DHTYPE_INT_INT
 typedef int DH_KEY_TYPE;
 typedef int DH_VALUE_TYPE;
-#elif KV_DHTYPE_CHAR_CHAR 1
-typedef int *DH_KEY_TYPE;
-typedef int *DH_VALUE_TYPE;
+typedef int DH_KEY_ARG_TYPE;//插入、查找、删除时传入的key的类型
+typedef int DH_VALUE_ARG_TYPE;//插入时传入的value的类型
+#elif KV_DHTYPE_CHAR_CHAR
+typedef char *DH_KEY_TYPE;
+typedef char *DH_VALUE_TYPE;
+typedef kv_slice DH_KEY_ARG_TYPE;//插入、查找、删除时传入的key的类型，带长度，不以'\0'结尾
+typedef kv_slice DH_VALUE_ARG_TYPE;//插入时传入的value的类型
 #endif
 
 //哈希表节点的定义
@@ -44,19 +50,23 @@ int kv_dhash_init(kv_dhash_t *kv_addr);
 int kv_dhash_desy(kv_dhash_t *kv_addr);
 
 //插入指令
-int kv_dhash_set(kv_dhash_t *kv_addr, char **tokens);
+int kv_dhash_set(kv_dhash_t *kv_addr, kv_slice *tokens);
 
 //查找指令
-char *kv_dhash_get(kv_dhash_t *kv_addr, char **tokens);
+char *kv_dhash_get(kv_dhash_t *kv_addr, kv_slice *tokens);
 
 //删除指令
-int kv_dhash_delete(kv_dhash_t *kv_addr, char **tokens);
+int kv_dhash_delete(kv_dhash_t *kv_addr, kv_slice *tokens);
 
 //计数指令
 int kv_dhash_count(kv_dhash_t *kv_addr);
 
 //存在指令
-int kv_dhash_exist(kv_dhash_t *kv_addr, char **tokens);
+int kv_dhash_exist(kv_dhash_t *kv_addr, kv_slice *tokens);
+
+//插入或覆盖指令，key已存在时只替换value，old不为NULL时通过old返回旧value的引用，由调用者释放
+//返回值：0插入了新key，1覆盖了已有的key，-1失败
+int kv_dhash_upsert(kv_dhash_t *kv_addr, kv_slice *tokens, char **old);
 
 /*------------函数声明------------*/
 #endif
\ No newline at end of file
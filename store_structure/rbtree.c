@@ -4,6 +4,7 @@
 #include <stdbool.h>
 
 #include "rbtree.h"
+#include "value.h"
 
 #define RED 1
 #define BLACK 0
@@ -28,7 +29,7 @@ void rbtree_free(rbtree *T);
 /*------插入------*/
 
 //红黑树插入
-int rbtree_insert(rbtree *T, RB_KEY_TYPE key, RB_VALUE_TYPE value);
+int rbtree_insert(rbtree *T, kv_slice key, kv_slice value);
 
 //红黑树插入后的调整
 void rbtree_insert_fixup(rbtree *T, rbtree_node *cur);
@@ -50,7 +51,7 @@ void rbtree_delete_fixup(rbtree *T, rbtree_node *cur);
 /*------查找------*/
 
 //红黑树查找
-rbtree_node *rbtree_search(rbtree *T, RB_KEY_TYPE key);
+rbtree_node *rbtree_search(rbtree *T, kv_slice key);
 
 /*------查找------*/
 
@@ -287,12 +288,12 @@ void rbtree_insert_fixup(rbtree *T, rbtree_node *cur) {
                     cur->color = BLACK;
                     cur = cur->parent;
                     rbtree_right_rotate(T, cur);
-                    rbtree_right_rotate(T, cur->parent->parent);
+                    rbtree_left_rotate(T, cur->parent->parent);
                 }
                 //RR:祖父变红/父变黑、祖父左旋，最后的当前节点应该是原来的当前节点
                 else {
                     cur->parent->parent->color = RED;
-                    cur->parent->color - BLACK;
+                    cur->parent->color = BLACK;
                     rbtree_left_rotate(T, cur->parent->parent);
                 }
             }
@@ -303,23 +304,25 @@ void rbtree_insert_fixup(rbtree *T, rbtree_node *cur) {
 }
 
 //插入
-int rbtree_insert(rbtree *T, RB_KEY_TYPE key, RB_VALUE_TYPE value) {
+int rbtree_insert(rbtree *T, kv_slice key, kv_slice value) {
     //首先寻找插入位置
     rbtree_node *cur = T->root_node;
     rbtree_node *next = T->root_node;//next为探测节点，以cur作为其前驱节点，知道cur为某叶节点的父节点
     //插入的位置一定是叶子节点
+    int cmp = 0;//cur的键与待插入键的比较结果
     while(next != T->nil_node) {
         cur = next;
+        cmp = kv_key_cmp(cur->key, key);
         //比当前键大，继续搜索右子树
-        if(strcmp(key, cur->key) > 0) {
+        if(cmp < 0) {
             next = cur->right;
         }
         //比当前键小，继续搜索左子树
-        else if(strcmp(key, cur->key) < 0) {
+        else if(cmp > 0) {
             next = cur->left;
         }
         //待插入键已经存在
-        else if(strcmp(key, cur->key) == 0) {
+        else {
             return -2;
         }
     }
@@ -331,22 +334,20 @@ int rbtree_insert(rbtree *T, RB_KEY_TYPE key, RB_VALUE_TYPE value) {
     if(new == NULL) {
         return -1;
     }
-    char *key_copy = (char *)malloc(strlen(key) + 1);
+    char *key_copy = kv_key_new(key);
     if(key_copy == NULL) {
         free(new);
         new = NULL;
         return -1;
     }
-    strncpy(key_copy, key, strlen(key) + 1);
-    char *value_copy = (char *)malloc(strlen(value) + 1);
+    char *value_copy = kv_value_new(value.data, value.len);
     if(value_copy == NULL) {
-        free(key_copy);
+        kv_key_free(key_copy);
         key_copy = NULL;
         free(new);
         new = NULL;
         return -1;
     }
-    strncpy(value_copy, value, strlen(value) + 1);
     new->key = key_copy;
     new->value = value_copy;
 
@@ -355,7 +356,7 @@ int rbtree_insert(rbtree *T, RB_KEY_TYPE key, RB_VALUE_TYPE value) {
         T->root_node = new;
     }
     //比cur的键大，插入到cur的右子树
-    else if(strcmp(new->key, cur->key) > 0) {
+    else if(cmp < 0) {
         cur->right = new;
     }
     //比cur的键小，插入到cur的左子树
@@ -501,9 +502,9 @@ void rbtree_delete(rbtree *T, rbtree_node *del) {
 
         //节点替换，转换为删除替代节点
         if(del != del_r) {
-            free(del->key);
+            kv_key_free(del->key);
             del->key = del_r->key;
-            free(del->value);
+            kv_value_unref(del->value);
             del->value = del_r->value;
         }
 
@@ -526,16 +527,17 @@ void rbtree_delete(rbtree *T, rbtree_node *del) {
 }
 
 //查找
-rbtree_node *rbtree_search(rbtree *T, RB_KEY_TYPE key) {
+rbtree_node *rbtree_search(rbtree *T, kv_slice key) {
     rbtree_node *cur = T->root_node;
     while(cur != T->nil_node) {
-        if(strcmp(cur->key, key) > 0) {
+        int cmp = kv_key_cmp(cur->key, key);
+        if(cmp > 0) {
             cur = cur->left;
         }
-        else if(strcmp(cur->key, key) < 0) {
+        else if(cmp < 0) {
             cur = cur->right;
         }
-        else if(strcmp(cur->key, key) == 0) {
+        else {
             return cur;
         }
     }
@@ -605,12 +607,12 @@ int kv_rbtree_desy(kv_rbtree_t *kv_addr) {
 }
 
 //插入指令
-int kv_rbtree_set(rbtree *kv_addr, char **tokens) {
+int kv_rbtree_set(rbtree *kv_addr, kv_slice *tokens) {
     return rbtree_insert(kv_addr, tokens[1], tokens[2]);
 }
 
 //查找指令
-char *kv_rbtree_get(rbtree *kv_addr, char **tokens) {
+char *kv_rbtree_get(rbtree *kv_addr, kv_slice *tokens) {
     rbtree_node *node = rbtree_search(kv_addr, tokens[1]);
     if(node != kv_addr->nil_node) {
         return node->value;
@@ -621,9 +623,9 @@ char *kv_rbtree_get(rbtree *kv_addr, char **tokens) {
 }
 
 //删除指令
-int kv_rbtree_delete(rbtree *kv_addr, char **tokens) {
+int kv_rbtree_delete(rbtree *kv_addr, kv_slice *tokens) {
     rbtree_node *node = rbtree_search(kv_addr, tokens[1]);
-    if(node == NULL) {
+    if(node == kv_addr->nil_node) {
         return -2;
     }
     rbtree_delete(kv_addr, node);
@@ -636,8 +638,23 @@ int kv_rbtree_count(rbtree *kv_addr) {
 }
 
 //存在指令
-int kv_rbtree_exist(rbtree *kv_addr, char **tokens) {
-    return (rbtree_search(kv_addr, tokens[1]) != NULL);
+int kv_rbtree_exist(rbtree *kv_addr, kv_slice *tokens) {
+    return (rbtree_search(kv_addr, tokens[1]) != kv_addr->nil_node);
+}
+
+//插入或覆盖指令
+//key已存在时只替换value指针，不改变数据结构
+int kv_rbtree_upsert(rbtree *kv_addr, kv_slice *tokens, char **old) {
+    rbtree_node *node = rbtree_search(kv_addr, tokens[1]);
+    if(node == kv_addr->nil_node) {
+        return (rbtree_insert(kv_addr, tokens[1], tokens[2]) == 0) ? 0 : -1;
+    }
+    char *value = kv_value_new(tokens[2].data, tokens[2].len);
+    if(value == NULL) {
+        return -1;
+    }
+    kv_value_replace(&node->value, value, old);
+    return 1;
 }
 
 /*------------KV函数定义------------*/
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef _RBTREE_H
 #define _RBTREE_H
 
+#include "value.h"
+
 #define KV_RBTYPE_INT_VOID 0
 #define KV_RBTYPE_CHAR_CHAR 1
 
@@ -45,19 +47,23 @@ int kv_rbtree_init(kv_rbtree_t *kv_addr);
 int kv_rbtree_desy(kv_rbtree_t *kv_addr);
 
 //插入指令
-int kv_rbtree_set(kv_rbtree_t *kv_addr, char **tokens);
+int kv_rbtree_set(kv_rbtree_t *kv_addr, kv_slice *tokens);
 
 //查找指令
-char *kv_rbtree_get(kv_rbtree_t *kv_addr, char **tokens);
+char *kv_rbtree_get(kv_rbtree_t *kv_addr, kv_slice *tokens);
 
 //删除指令
-int kv_rbtree_delete(kv_rbtree_t *kv_addr, char **tokens);
+int kv_rbtree_delete(kv_rbtree_t *kv_addr, kv_slice *tokens);
 
 //计数指令
 int kv_rbtree_count(kv_rbtree_t *kv_addr);
 
 //存在指令
-int kv_rbtree_exist(kv_rbtree_t *kv_addr, char **tokens);
+int kv_rbtree_exist(kv_rbtree_t *kv_addr, kv_slice *tokens);
+
+//插入或覆盖指令，key已存在时只替换value，old不为NULL时通过old返回旧value的引用，由调用者释放
+//返回值：0插入了新key，1覆盖了已有的key，-1失败
+int kv_rbtree_upsert(kv_rbtree_t *kv_addr, kv_slice *tokens, char **old);
 
 /*------------KV函数声明------------*/
 #endif
\ No newline at end of file
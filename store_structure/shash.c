@@ -2,14 +2,15 @@
 #include <string.h>
 #include <stdlib.h>
 #include "shash.h"
+#include "value.h"
 
 /*------------函数声明------------*/
 
 //计算哈希值
-static int _hash(H_KEY_TYPE key, int size);
+static int _hash(H_KEY_ARG_TYPE key, int size);
 
 //创建哈希表节点
-hashNode_t *hash_node_create(H_KEY_TYPE key, H_VALUE_TYPE value);
+hashNode_t *hash_node_create(H_KEY_ARG_TYPE key, H_VALUE_ARG_TYPE value);
 
 //销毁哈希节点
 int hash_node_desy(hashNode_t *node);
@@ -21,13 +22,13 @@ int hash_table_init(hashTable_t *hash);
 int hash_table_desy(hashTable_t *hash);
 
 //插入元素（冲突：拉链法的头插法）
-int hash_node_insert(hashTable_t *hash, H_KEY_TYPE key, H_VALUE_TYPE value);
+int hash_node_insert(hashTable_t *hash, H_KEY_ARG_TYPE key, H_VALUE_ARG_TYPE value);
 
 //查找元素
-hashNode_t *hash_node_search(hashTable_t *hash, H_KEY_TYPE key);
+hashNode_t *hash_node_search(hashTable_t *hash, H_KEY_ARG_TYPE key);
 
 //删除元素
-int hash_node_delete(hashTable_t *hash, H_KEY_TYPE key);
+int hash_node_delete(hashTable_t *hash, H_KEY_ARG_TYPE key);
 
 //打印哈希表
 int hash_table_print(hashTable_t *hash);
@@ -38,26 +39,26 @@ int hash_table_print(hashTable_t *hash);
 /*------------函数定义------------*/
 
 //计算哈希值
-static int _hash(H_KEY_TYPE key, int size) {
+static int _hash(H_KEY_ARG_TYPE key, int size) {
 #if KV_HTYPE_INT_INT
     if(key < 0) {
         return -1;
     }
     return key % size;//直接返回键对哈希表长度取余
 #elif KV_HTYPE_CHAR_CHAR
-    if(key == NULL) {
+    if(key.data == NULL) {
         return -1;
     }
     int sum = 0;
-    for(int i = 0; key[i] != 0; i++) {
-        sum += key[i];
+    for(size_t i = 0; i < key.len; i++) {
+        sum += key.data[i];
     }
     return sum % size;//所有字符的ASCII码累加后对哈希表长度取余
 #endif
 }
 
 //创建哈希节点
-hashNode_t *hash_node_create(H_KEY_TYPE key, H_VALUE_TYPE value) {
+hashNode_t *hash_node_create(H_KEY_ARG_TYPE key, H_VALUE_ARG_TYPE value) {
     hashNode_t *node = (hashNode_t *)calloc(1, sizeof(hashNode_t));
     if(node == NULL) {
         return NULL;
@@ -66,22 +67,20 @@ hashNode_t *hash_node_create(H_KEY_TYPE key, H_VALUE_TYPE value) {
     node->key = key;
     node->value = value;
 #elif KV_HTYPE_CHAR_CHAR
-    char *key_copy = (char *)calloc(strlen(key) + 1, sizeof(char));
+    char *key_copy = kv_key_new(key);
     if(key_copy == NULL) {
         free(node);
         node = NULL;
         return NULL;
     }
-    char *value_copy = (char *)calloc(strlen(value) + 1, sizeof(char));
+    char *value_copy = kv_value_new(value.data, value.len);
     if(value_copy == NULL) {
-        free(key_copy);
+        kv_key_free(key_copy);
         key_copy = NULL;
         free(node);
         node = NULL;
         return NULL;
     }
-    strncpy(key_copy, key, strlen(key) + 1);
-    strncpy(value_copy, value, strlen(value) + 1);
     node->key = key_copy;
     node->value = value_copy;
 #endif
@@ -95,11 +94,11 @@ int hash_node_desy(hashNode_t *node) {
         return -1;
     }
     if(node->value) {
-        free(node->value);
+        kv_value_unref(node->value);
         node->value = NULL;
     }
     if(node->key) {
-        free(node->key);
+        kv_key_free(node->key);
         node->key = NULL;
     }
     node->next = NULL;
@@ -150,11 +149,11 @@ int hash_table_desy(hashTable_t *hash) {
 }
 
 //插入元素
-int hash_node_insert(hashTable_t *hash, H_KEY_TYPE key, H_VALUE_TYPE value) {
+int hash_node_insert(hashTable_t *hash, H_KEY_ARG_TYPE key, H_VALUE_ARG_TYPE value) {
 #if KV_HTYPE_INT_INT
     if (!hash || key<0) return -1;
 #elif KV_HTYPE_CHAR_CHAR
-    if(!hash || !key || !value) {
+    if(!hash || !key.data || !value.data) {
         return -1;
     }
 #endif
@@ -166,7 +165,7 @@ int hash_node_insert(hashTable_t *hash, H_KEY_TYPE key, H_VALUE_TYPE value) {
 #if KV_HTYPE_INT_INT
         if(node->key == key) return -2;
 #elif KV_HTYPE_CHAR_CHAR
-        if(strcmp(node->key, key) == 0) {
+        if(kv_key_cmp(node->key, key) == 0) {
             return -2;
         }
 #endif
@@ -185,11 +184,11 @@ int hash_node_insert(hashTable_t *hash, H_KEY_TYPE key, H_VALUE_TYPE value) {
 }
 
 //查找元素
-hashNode_t *hash_node_search(hashTable_t *hash, H_KEY_TYPE key) {
+hashNode_t *hash_node_search(hashTable_t *hash, H_KEY_ARG_TYPE key) {
 #if KV_HTYPE_INT_INT
     if (!hash || key<0) return NULL;
 #elif KV_HTYPE_CHAR_CHAR
-    if (!hash || !key) return NULL;
+    if (!hash || !key.data) return NULL;
 #endif
     int index = _hash(key, hash->table_size);
     hashNode_t *node = hash->nodes[index];
@@ -197,7 +196,7 @@ hashNode_t *hash_node_search(hashTable_t *hash, H_KEY_TYPE key) {
 #if KV_HTYPE_INT_INT
         if(node->key == key) return node;
 #elif KV_HTYPE_CHAR_CHAR
-        if(strcmp(node->key, key) == 0) {
+        if(kv_key_cmp(node->key, key) == 0) {
             return node;
         }
 #endif
@@ -208,11 +207,11 @@ hashNode_t *hash_node_search(hashTable_t *hash, H_KEY_TYPE key) {
 }
 
 //删除元素
-int hash_delete_node(hashTable_t *hash, H_KEY_TYPE key) {
+int hash_node_delete(hashTable_t *hash, H_KEY_ARG_TYPE key) {
 #if KV_HTYPE_INT_INT
     if (!hash || key<0) return -1;
 #elif KV_HTYPE_CHAR_CHAR
-    if (!hash || !key) return -1;
+    if (!hash || !key.data) return -1;
 #endif
     int index = _hash(key, hash->table_size);
     hashNode_t *node = hash->nodes[index];
@@ -223,7 +222,7 @@ int hash_delete_node(hashTable_t *hash, H_KEY_TYPE key) {
 #if KV_HTYPE_INT_INT
     if (cur_node->key == key)
 #elif KV_HTYPE_CHAR_CHAR
-    if (strcmp(node->key, key) == 0)
+    if (kv_key_cmp(node->key, key) == 0)
 #endif
     {
         hashNode_t *next_node = node->next;
@@ -244,7 +243,7 @@ int hash_delete_node(hashTable_t *hash, H_KEY_TYPE key) {
 #if KV_HTYPE_INT_INT
             if (cur_node->key == key) break;
 #elif KV_HTYPE_CHAR_CHAR
-            if (strcmp(node->key, key) == 0) break;
+            if (kv_key_cmp(node->key, key) == 0) break;
 #endif
             pre_node = node;
             node = node->next;
@@ -257,6 +256,7 @@ int hash_delete_node(hashTable_t *hash, H_KEY_TYPE key) {
             pre_node->next = node->next;
             hash->count--;
             hash_node_desy(node);
+            return 0;
         }
     }
 }
@@ -285,7 +285,7 @@ int hash_table_print(hashTable_t *hash) {
 }
 
 //KV初始化
-int kv_hash_init(kv_shash_t *kv_addr) {
+int kv_shash_init(kv_shash_t *kv_addr) {
     if(kv_addr == NULL) {
         return -1;
     }
@@ -293,7 +293,7 @@ int kv_hash_init(kv_shash_t *kv_addr) {
 }
 
 //KV销毁
-int kv_hash_desy(kv_shash_t *kv_addr) {
+int kv_shash_desy(kv_shash_t *kv_addr) {
     if(kv_addr == NULL) {
         return -1;
     }
@@ -301,16 +301,16 @@ int kv_hash_desy(kv_shash_t *kv_addr) {
 }
 
 //插入指令
-int kv_hash_set(kv_shash_t *kv_addr, char **tokens) {
-    if(kv_addr == NULL || tokens==NULL || tokens[1]==NULL || tokens[2]==NULL) {
+int kv_shash_set(kv_shash_t *kv_addr, kv_slice *tokens) {
+    if(kv_addr == NULL || tokens==NULL || tokens[1].data==NULL || tokens[2].data==NULL) {
         return -1;
     }
     return hash_node_insert(kv_addr, tokens[1], tokens[2]);
 }
 
 //查找指令
-char *kv_hash_get(kv_shash_t *kv_addr, char **tokens) {
-    if(kv_addr == NULL || tokens == NULL || tokens[1] == NULL) {
+char *kv_shash_get(kv_shash_t *kv_addr, kv_slice *tokens) {
+    if(kv_addr == NULL || tokens == NULL || tokens[1].data == NULL) {
         return NULL;
     }
     hashNode_t *node = hash_node_search(kv_addr, tokens[1]);
@@ -321,18 +321,33 @@ char *kv_hash_get(kv_shash_t *kv_addr, char **tokens) {
 }
 
 //删除指令
-int kv_hash_delete(kv_shash_t *kv_addr, char **tokens) {
+int kv_shash_delete(kv_shash_t *kv_addr, kv_slice *tokens) {
     return hash_node_delete(kv_addr, tokens[1]);
 }
 
 //计数指令
-int kv_hash_count(kv_shash_t *kv_addr) {
+int kv_shash_count(kv_shash_t *kv_addr) {
     return kv_addr->count;
 }
 
 //存在指令
-int kv_hash_exist(kv_shash_t *kv_addr, char **tokens) {
+int kv_shash_exist(kv_shash_t *kv_addr, kv_slice *tokens) {
     return (hash_node_search(kv_addr, tokens[1]) != NULL);
 }
 
+//插入或覆盖指令
+//key已存在时只替换value指针，不改变数据结构
+int kv_shash_upsert(kv_shash_t *kv_addr, kv_slice *tokens, char **old) {
+    hashNode_t *node = hash_node_search(kv_addr, tokens[1]);
+    if(node == NULL) {
+        return (hash_node_insert(kv_addr, tokens[1], tokens[2]) == 0) ? 0 : -1;
+    }
+    char *value = kv_value_new(tokens[2].data, tokens[2].len);
+    if(value == NULL) {
+        return -1;
+    }
+    kv_value_replace(&node->value, value, old);
+    return 1;
+}
+
 /*------------函数定义------------*/
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef _SHASH_H
 #define _SHASH_H
 
+#include "value.h"
+
 #define KV_HTYPE_INT_INT 0
 #define KV_HTYPE_CHAR_CHAR 1
 
@@ -11,16 +13,20 @@
 #if KV_HTYPE_INT_INT
 typedef int H_KEY_TYPE;
 typedef int H_VALUE_TYPE;
+typedef int H_KEY_ARG_TYPE;//插入、查找、删除时传入的key的类型
+typedef int H_VALUE_ARG_TYPE;//插入时传入的value的类型
 #elif KV_HTYPE_CHAR_CHAR
 typedef char *H_KEY_TYPE;
 typedef char *H_VALUE_TYPE;
+typedef kv_slice H_KEY_ARG_TYPE;//插入、查找、删除时传入的key的类型，带长度，不以'\0'结尾
+typedef kv_slice H_VALUE_ARG_TYPE;//插入时传入的value的类型
 #endif
 
 //哈希表节点(存储单个键值对)结构体
 typedef struct hashNode_s {
     H_KEY_TYPE key;//键
     H_VALUE_TYPE value;//值
-    struct hash_node_s *next;//同一哈希索引对应的哈希链表中的下一节点
+    struct hashNode_s *next;//同一哈希索引对应的哈希链表中的下一节点
 } hashNode_t;
 
 //哈希表结构体
@@ -35,25 +41,29 @@ typedef hashTable_t kv_shash_t;
 /*------------KV功能函数声明------------*/
 
 //初始化
-int kv_hash_init(kv_shash_t *kv_addr);
+int kv_shash_init(kv_shash_t *kv_addr);
 
 //销毁
-int kv_hash_desy(kv_shash_t *kv_addr);
+int kv_shash_desy(kv_shash_t *kv_addr);
 
 //插入指令
-int kv_hash_set(kv_shash_t *kv_addr, char **tokens);
+int kv_shash_set(kv_shash_t *kv_addr, kv_slice *tokens);
 
 //查找指令
-char *kv_hash_get(kv_shash_t *kv_addr, char **tokens);
+char *kv_shash_get(kv_shash_t *kv_addr, kv_slice *tokens);
 
 //删除指令
-int kv_hash_delete(kv_shash_t *kv_addr, char **tokens);
+int kv_shash_delete(kv_shash_t *kv_addr, kv_slice *tokens);
 
 //计数指令
-int kv_hash_count(kv_shash_t *kv_addr);
+int kv_shash_count(kv_shash_t *kv_addr);
 
 //存在指令
-int kv_hash_exist(kv_shash_t *kv_addr, char **tokens);
+int kv_shash_exist(kv_shash_t *kv_addr, kv_slice *tokens);
+
+//插入或覆盖指令，key已存在时只替换value，old不为NULL时通过old返回旧value的引用，由调用者释放
+//返回值：0插入了新key，1覆盖了已有的key，-1失败
+int kv_shash_upsert(kv_shash_t *kv_addr, kv_slice *tokens, char **old);
 
 /*------------KV功能函数声明------------*/
 #endif
\ No newline at end of file
@@ -2,12 +2,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include "skiplist.h"
+#include "value.h"
 
 /*------------skiplist操作函数声明------------*/
 
 //创建节点并初始化
 //注意还有参数level指示新创建节点位于哪个层级
-skiplist_node_t *skiplist_node_create(Z_KEY_TYPE key, Z_VALUE_TYPE value, int level);
+skiplist_node_t *skiplist_node_create(kv_slice key, kv_slice value, int level);
 
 //销毁节点
 int skiplist_node_desy(skiplist_node_t *node);
@@ -19,13 +20,13 @@ int skiplist_init(skiplist_t *list, int max_level);
 int skiplist_desy(skiplist_t *list);
 
 //插入元素
-int skiplist_node_insert(skiplist_t *list, Z_KEY_TYPE key, Z_VALUE_TYPE value);
+int skiplist_node_insert(skiplist_t *list, kv_slice key, kv_slice value);
 
 //查找元素
-skiplist_node_t *skiplist_node_search(skiplist_t *list, Z_KEY_TYPE key);
+skiplist_node_t *skiplist_node_search(skiplist_t *list, kv_slice key);
 
 //删除元素
-int skiplist_node_delete(skiplist_t *list, Z_KEY_TYPE key);
+int skiplist_node_delete(skiplist_t *list, kv_slice key);
 
 //打印跳表
 int skiplist_print(skiplist_t *list);
@@ -37,8 +38,8 @@ int skiplist_print(skiplist_t *list);
 //在所有函数的实现中，只考虑键值对类型为char*和char*类型的实现
 
 //创建一个位于层级level的节点(在某个层创建新节点)
-skiplist_node_t *skiplist_node_create(Z_KEY_TYPE key, Z_KEY_TYPE value, int level) {
-    if(key == NULL || value == NULL || level <= 0) {//这里的level检查应该还需要小于max_level，或者留到需要创建新节点时再检查
+skiplist_node_t *skiplist_node_create(kv_slice key, kv_slice value, int level) {
+    if(key.data == NULL || value.data == NULL || level <= 0) {//这里的level检查应该还需要小于max_level，或者留到需要创建新节点时再检查
         return NULL;
     }
     //创建节点
@@ -58,19 +59,18 @@ skiplist_node_t *skiplist_node_create(Z_KEY_TYPE key, Z_KEY_TYPE value, int leve
         new_node->next[i] = NULL;
     }
     //初始化键值对
-    char *key_copy = (char *)calloc(strlen(key) + 1, sizeof(char));
+    char *key_copy = kv_key_new(key);
     if(key_copy == NULL) {
         skiplist_node_desy(new_node);
         return NULL;
     }
-    char *value_copy = (char *)calloc(strlen(value) + 1, sizeof(char));
+    char *value_copy = kv_value_new(value.data, value.len);
     if(value_copy == NULL) {
+        kv_key_free(key_copy);
         skiplist_node_desy(new_node);
         return NULL;
     }
 
-    strncpy(key_copy, key, strlen(key) + 1);
-    strncpy(value_copy, value, strlen(value));
     new_node->key = key_copy;
     new_node->value = value_copy;
 
@@ -84,11 +84,11 @@ int skiplist_node_desy(skiplist_node_t *node) {
         return -1;
     }
     if(node->value) {
-        free(node->key);
+        kv_key_free(node->key);
         node->key = NULL;
     }
     if(node->value) {
-        free(node->value);
+        kv_value_unref(node->value);
         node->value = NULL;
     }
     if(node->next) {
@@ -164,7 +164,7 @@ int skiplist_desy(skiplist_t *list) {
 }
 
 //插入元素：若发生冲突，选择头插法
-int skiplist_node_insert(skiplist_t *list, Z_KEY_TYPE key, Z_VALUE_TYPE value) {
+int skiplist_node_insert(skiplist_t *list, kv_slice key, kv_slice value) {
     //首先寻找新节点应该插入的位置
     skiplist_node_t *update[list->max_level];//搜索插入位置时的查找路径
     skiplist_node_t *pre = list->header;
@@ -173,12 +173,12 @@ int skiplist_node_insert(skiplist_t *list, Z_KEY_TYPE key, Z_VALUE_TYPE value) {
         因为较高层一次next操作可以跳过更多元素
     */
     for(int i = list->cur_level - 1; i >= 0; i--) {
-        while(pre->next[i] != NULL && strcmp(pre->next[i]->key, key) < 0) {//若当前层的下一个节点依旧小于key，继续循环
+        while(pre->next[i] != NULL && kv_key_cmp(pre->next[i]->key, key) < 0) {//若当前层的下一个节点依旧小于key，继续循环
             pre = pre->next[i];
         }
         update[i] = pre;//update存储的是每一层中最后一个小于目标key的节点
     }
-    if(pre->next[0] != NULL && strcmp(pre->next[0]->key, key) == 0) {//该key已经存在于跳表中
+    if(pre->next[0] != NULL && kv_key_cmp(pre->next[0]->key, key) == 0) {//该key已经存在于跳表中
         return -2;
     }
     else {//可以插入，且已经找到插入位置，插入位置即为pre节点的下一个位置
@@ -210,35 +210,35 @@ int skiplist_node_insert(skiplist_t *list, Z_KEY_TYPE key, Z_VALUE_TYPE value) {
 }
 
 //查找元素，在插入新元素函数中亦有实现
-skiplist_node_t *skiplist_node_search(skiplist_t *list, Z_KEY_TYPE key) {
+skiplist_node_t *skiplist_node_search(skiplist_t *list, kv_slice key) {
     //从头节点开始找
     skiplist_node_t *pre = list->header;
     for(int i = list->cur_level - 1; i >= 0; i--) {
-        while(pre->next[i] != NULL && strcmp(pre->next[i]->key, key) < 0) {
+        while(pre->next[i] != NULL && kv_key_cmp(pre->next[i]->key, key) < 0) {
             pre = pre->next[i];
         }
     }
     //判断下一个元素是否是当前key
-    if(pre->next[0] != NULL && strcmp(pre->next[0]->key, key) == 0) {
+    if(pre->next[0] != NULL && kv_key_cmp(pre->next[0]->key, key) == 0) {
         return pre->next[0];
     }
     return NULL;
 }
 
 //删除元素
-int skiplist_node_delete(skiplist_t *list, Z_KEY_TYPE key) {
+int skiplist_node_delete(skiplist_t *list, kv_slice key) {
     skiplist_node_t *update[list->max_level];
     skiplist_node_t *pre = list->header;
     //首先进行查找操作
     for(int i = list->cur_level - 1; i >= 0; i--){
-        while(pre->next[i] != NULL && strcmp(pre->next[i]->key, key) < 0) {
+        while(pre->next[i] != NULL && kv_key_cmp(pre->next[i]->key, key) < 0) {
             pre = pre->next[i];
         }
         update[i] = pre;
     }
 
     //待删除节点存在于跳表中，删除节点并更新指向信息
-    if(pre->next[0] != NULL && strcmp(pre->next[0]->key, key) == 0) {
+    if(pre->next[0] != NULL && kv_key_cmp(pre->next[0]->key, key) == 0) {
         skiplist_node_t *node_del = pre->next[0];//node_del记载待删除元素
         for(int i = 0; i < list->cur_level; i++) {//更新指向信息
             if(update[i]->next[i] == node_del) {//只要记载的指针指向待删除节点，就将其指向待删除节点的下一个节点
@@ -302,16 +302,16 @@ int kv_skiplist_desy(kv_skiplist_t *kv_addr) {
 }
 
 //插入指令
-int kv_skiplist_set(kv_skiplist_t *kv_addr, char **tokens) {
-    if(kv_addr == NULL || tokens == NULL || tokens[1] == NULL || tokens[2] == NULL) {
+int kv_skiplist_set(kv_skiplist_t *kv_addr, kv_slice *tokens) {
+    if(kv_addr == NULL || tokens == NULL || tokens[1].data == NULL || tokens[2].data == NULL) {
         return -1;
     }
     return skiplist_node_insert(kv_addr, tokens[1], tokens[2]);
 }
 
 //查找指令
-char *kv_skiplist_get(kv_skiplist_t *kv_addr, char **tokens) {
-    if(kv_addr == NULL || tokens == NULL || tokens[1] == NULL) {
+char *kv_skiplist_get(kv_skiplist_t *kv_addr, kv_slice *tokens) {
+    if(kv_addr == NULL || tokens == NULL || tokens[1].data == NULL) {
         return NULL;
     }
     skiplist_node_t *node = skiplist_node_search(kv_addr, tokens[1]);
@@ -322,8 +322,8 @@ char *kv_skiplist_get(kv_skiplist_t *kv_addr, char **tokens) {
 }
 
 //删除指令
-int kv_skiplist_delete(kv_skiplist_t *kv_addr, char **tokens) {
-    if(kv_addr == NULL || tokens == NULL || tokens[1] == NULL) {
+int kv_skiplist_delete(kv_skiplist_t *kv_addr, kv_slice *tokens) {
+    if(kv_addr == NULL || tokens == NULL || tokens[1].data == NULL) {
         return -1;
     }
     return skiplist_node_delete(kv_addr, tokens[1]);
@@ -335,8 +335,23 @@ int kv_skiplist_count(kv_skiplist_t *kv_addr) {
 }
 
 //存在指令
-int kv_skiplist_exist(kv_skiplist_t *kv_addr, char **tokens) {
+int kv_skiplist_exist(kv_skiplist_t *kv_addr, kv_slice *tokens) {
     return (skiplist_node_search(kv_addr, tokens[1]) != NULL);
 }
 
+//插入或覆盖指令
+//key已存在时只替换value指针，不改变数据结构
+int kv_skiplist_upsert(kv_skiplist_t *kv_addr, kv_slice *tokens, char **old) {
+    skiplist_node_t *node = skiplist_node_search(kv_addr, tokens[1]);
+    if(node == NULL) {
+        return (skiplist_node_insert(kv_addr, tokens[1], tokens[2]) == 0) ? 0 : -1;
+    }
+    char *value = kv_value_new(tokens[2].data, tokens[2].len);
+    if(value == NULL) {
+        return -1;
+    }
+    kv_value_replace(&node->value, value, old);
+    return 1;
+}
+
 /*------------函数定义------------*/
\ No newline at end of file
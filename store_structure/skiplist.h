@@ -1,6 +1,8 @@
 #ifndef __SKIPLIST_H
 #define __SKIPLIST_H
 
+#include "value.h"
+
 #define KV_ZTYPE_INT_INT 0
 #define KV_ZTYPE_CHAR_CHAR 1
 
@@ -41,19 +43,23 @@ int kv_skiplist_init(kv_skiplist_t *kv_addr, int m);
 int kv_skiplist_desy(kv_skiplist_t *kv_addr);
 
 //插入指令
-int kv_skiplist_set(kv_skiplist_t *kv_addr, char **tokens);
+int kv_skiplist_set(kv_skiplist_t *kv_addr, kv_slice *tokens);
 
 //查找指令
-char *kv_skiplist_get(kv_skiplist_t *kv_addr, char **tokens);
+char *kv_skiplist_get(kv_skiplist_t *kv_addr, kv_slice *tokens);
 
 //删除指令
-int kv_skiplist_delete(kv_skiplist_t *kv_addr, char **tokens);
+int kv_skiplist_delete(kv_skiplist_t *kv_addr, kv_slice *tokens);
 
 //计数指令
 int kv_skiplist_count(kv_skiplist_t *kv_addr);
 
 //存在指令
-int kv_skiplist_exist(kv_skiplist_t *kv_addr, char **tokens);
+int kv_skiplist_exist(kv_skiplist_t *kv_addr, kv_slice *tokens);
+
+//插入或覆盖指令，key已存在时只替换value，old不为NULL时通过old返回旧value的引用，由调用者释放
+//返回值：0插入了新key，1覆盖了已有的key，-1失败
+int kv_skiplist_upsert(kv_skiplist_t *kv_addr, kv_slice *tokens, char **old);
 
 /*------------KV函数声明------------*/
 #endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "value.h"
+
+//由value字符串找到其头部
+#define kv_value_hdr(value) ((kv_value_hdr_t *)(value) - 1)
+
+/*------------value功能函数实现------------*/
+//创建value：头部和字符串一次分配
+char *kv_value_new(const char *data, size_t len) {
+    kv_value_hdr_t *hdr = (kv_value_hdr_t *)malloc(sizeof(kv_value_hdr_t) + len + 1);
+    if(hdr == NULL) {
+        perror("kv_value_new : malloc fail\n");
+        return NULL;
+    }
+    hdr->refcount = 1;
+    hdr->flags = 0;
+    hdr->len = len;
+    char *value = (char *)(hdr + 1);
+    memcpy(value, data, len);
+    value[len] = '\0';
+    return value;
+}
+
+//增加引用计数
+//调用者必须已经持有一个引用，或者持有存储该value的引擎的锁
+char *kv_value_ref(char *value) {
+    if(value) {
+        __atomic_add_fetch(&kv_value_hdr(value)->refcount, 1, __ATOMIC_RELAXED);
+    }
+    return value;
+}
+
+//减少引用计数，最后一个引用释放时回收内存
+void kv_value_unref(char *value) {
+    if(value == NULL) {
+        return;
+    }
+    kv_value_hdr_t *hdr = kv_value_hdr(value);
+    if(__atomic_sub_fetch(&hdr->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(hdr);
+    }
+}
+
+//value长度
+size_t kv_value_len(const char *value) {
+    return ((const kv_value_hdr_t *)value - 1)->len;
+}
+
+//value的flags
+unsigned int kv_value_flags(const char *value) {
+    return ((const kv_value_hdr_t *)value - 1)->flags;
+}
+
+//设置value的flags
+void kv_value_set_flags(char *value, unsigned int flags) {
+    kv_value_hdr(value)->flags = flags;
+}
+
+//替换value，正在发送旧value的连接持有自己的引用，不受影响
+void kv_value_replace(char **slot, char *value, char **old) {
+    char *prev = *slot;
+    *slot = value;
+    if(old) {
+        *old = prev;
+    }
+    else {
+        kv_value_unref(prev);
+    }
+}
+/*------------value功能函数实现------------*/
+
+
+/*------------key功能函数实现------------*/
+//创建key
+char *kv_key_new(kv_slice key) {
+    return kv_value_new(key.data, key.len);
+}
+
+//释放key
+void kv_key_free(char *key) {
+    kv_value_unref(key);
+}
+
+//由key头部中保存的长度构造slice
+kv_slice kv_key_slice(const char *key) {
+    kv_slice slice = {key, kv_value_len(key)};
+    return slice;
+}
+
+//先比较公共长度部分，相同时较短的key较小
+int kv_key_cmp(const char *key, kv_slice slice) {
+    size_t len = kv_value_len(key);
+    int diff = memcmp(key, slice.data, len < slice.len ? len : slice.len);
+    if(diff != 0) {
+        return diff;
+    }
+    return (len > slice.len) - (len < slice.len);
+}
+/*------------key功能函数实现------------*/
@@ -0,0 +1,65 @@
+#ifndef _VALUE_H
+#define _VALUE_H
+
+#include <stddef.h>
+
+//引用计数的value，所有存储引擎通过这组函数创建和释放value
+//计数和长度存放在value字符串之前，引擎和协议层仍然把value当作以'\0'结尾的char *使用
+//get指令的回复持有一个引用直接发送value的内存，value被删除后内存在最后一个引用释放时才回收
+
+//value头部，紧邻value字符串之前
+typedef struct kv_value_hdr_s {
+    int refcount;//引用计数，由多个reactor线程原子地修改
+    unsigned int flags;//客户端附带的不透明标志，memcached协议的flags，占用refcount之后的对齐空间
+    size_t len;//value长度，不含末尾的'\0'
+}kv_value_hdr_t;
+
+//指令中的一个参数：指向接收缓冲区中的数据和长度，不以'\0'结尾，可以包含任意字节
+//引擎通过slice接收key和value，不需要再用strlen计算长度
+typedef struct kv_slice_s {
+    const char *data;
+    size_t len;
+}kv_slice;
+
+/*------------value功能函数声明------------*/
+//拷贝len字节创建value，引用计数为1，失败返回NULL
+char *kv_value_new(const char *data, size_t len);
+
+//增加引用计数，返回value本身
+char *kv_value_ref(char *value);
+
+//减少引用计数，减到0时释放，value为NULL时不做任何操作
+void kv_value_unref(char *value);
+
+//value长度，不需要遍历字符串
+size_t kv_value_len(const char *value);
+
+//value的flags，创建时为0
+unsigned int kv_value_flags(const char *value);
+
+//设置value的flags，只能在value被其他线程读取之前调用，即持有引擎写锁时对刚插入的value调用
+void kv_value_set_flags(char *value, unsigned int flags);
+
+//用value替换引擎中*slot保存的value，只交换指针，不改变引擎的数据结构，调用者持有引擎写锁
+//old不为NULL时旧value的引用交给调用者，由调用者释放，否则直接释放
+void kv_value_replace(char **slot, char *value, char **old);
+/*------------value功能函数声明------------*/
+
+
+/*------------key功能函数声明------------*/
+//引擎中保存的key与value格式相同，长度保存在头部，比较时不需要strlen，引用计数始终为1
+
+//拷贝slice创建key，失败返回NULL
+char *kv_key_new(kv_slice key);
+
+//释放key，key为NULL时不做任何操作
+void kv_key_free(char *key);
+
+//把引擎中保存的key或value重新包装为slice，用于扩容、缩容时重新插入
+kv_slice kv_key_slice(const char *key);
+
+//按字节的字典序比较引擎中的key与slice，key较小、相等、较大时分别返回负数、0、正数，不含'\0'时与strcmp的结果一致
+int kv_key_cmp(const char *key, kv_slice slice);
+/*------------key功能函数声明------------*/
+
+#endif